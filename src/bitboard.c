@@ -0,0 +1,210 @@
+#include "bitboard.h"
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+uint64_t knight_attacks[64];
+uint64_t king_attacks[64];
+uint64_t pawn_attacks[2][64];
+uint64_t between_squares[64][64];
+uint64_t line_through[64][64];
+
+struct magic bishop_magics[64];
+struct magic rook_magics[64];
+bool use_pext = false;
+
+uint64_t zobrist_pieces[2][TYPE_PAWN + 1][64];
+uint64_t zobrist_castle[16];
+uint64_t zobrist_en_passant[8];
+uint64_t zobrist_black;
+
+// every blocker combination of every square, 2^(number of relevant blockers) entries per square
+static uint64_t bishop_table[5248];
+static uint64_t rook_table[102400];
+
+// rays in each direction from each square, not including the square itself
+// the first four directions go towards higher square numbers, the last four towards lower ones
+static uint64_t rays[8][64];
+
+static const struct position ray_directions[8] = {
+        {0,  1 },
+        {1,  0 },
+        {1,  1 },
+        {-1, 1 },
+        {0,  -1},
+        {-1, 0 },
+        {-1, -1},
+        {1,  -1}
+};
+
+static uint64_t offsets_to_bitboard(uint8_t sq, const struct position *offsets, uint8_t count) {
+	uint64_t bb = 0;
+	for (uint8_t i = 0; i < count; ++i) {
+		int8_t x = SQUARE_X(sq) + offsets[i].x;
+		int8_t y = SQUARE_Y(sq) + offsets[i].y;
+		if (position_valid_xy(x, y)) bb |= BIT(SQUARE(x, y));
+	}
+	return bb;
+}
+
+static uint64_t ray_attacks(uint8_t d, uint8_t sq, uint64_t occupied) {
+	// the attack ray stops at the first blocker, which is included so it can be captured
+	uint64_t ray = rays[d][sq];
+	uint64_t blockers = ray & occupied;
+	if (!blockers) return ray;
+	uint8_t blocker = d < 4 ? bb_first(blockers) : 63 - __builtin_clzll(blockers);
+	return ray ^ rays[d][blocker];
+}
+
+static uint64_t slider_attacks_slow(bool rook, uint8_t sq, uint64_t occupied) {
+	// only used to fill the lookup tables
+	uint8_t first = rook ? 0 : 2;
+	return ray_attacks(first, sq, occupied) | ray_attacks(first + 1, sq, occupied) | ray_attacks(first + 4, sq, occupied) | ray_attacks(first + 5, sq, occupied);
+}
+
+static bool cpu_has_bmi2(void) {
+#if defined(__x86_64__)
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+	return (ebx & bit_BMI2) != 0;
+#else
+	return false;
+#endif
+}
+
+static uint64_t random_u64(uint64_t *state) {
+	// xorshift64*, seeded with a constant so startup always does the same amount of work
+	*state ^= *state >> 12;
+	*state ^= *state << 25;
+	*state ^= *state >> 27;
+	return *state * 2685821657736338717ULL;
+}
+
+static void init_slider_tables(bool rook, struct magic *magics, uint64_t *table) {
+	static uint64_t occupancy[4096], reference[4096];
+	static uint32_t epoch[4096];
+	// per rank seeds known to find magics quickly with this generator
+	const uint64_t seeds[8] = {728, 10316, 55013, 32803, 12281, 15100, 16645, 255};
+	uint32_t attempt = 0;
+	size_t offset = 0;
+
+	memset(epoch, 0, sizeof(epoch));
+	for (uint8_t sq = 0; sq < 64; ++sq) {
+		struct magic *m = &magics[sq];
+		// blockers on the edge of the board do not change the attacks
+		uint64_t edges = ((BB_RANK_1 | BB_RANK_8) & ~(BB_RANK_1 << (8 * SQUARE_Y(sq)))) |
+		                 ((BB_FILE_A | BB_FILE_H) & ~(BB_FILE_A << SQUARE_X(sq)));
+		m->mask = slider_attacks_slow(rook, sq, 0) & ~edges;
+		m->shift = 64 - bb_count(m->mask);
+		m->attacks = table + offset;
+
+		// enumerate every subset of the mask
+		size_t size = 0;
+		uint64_t subset = 0;
+		do {
+			occupancy[size] = subset;
+			reference[size] = slider_attacks_slow(rook, sq, subset);
+			if (use_pext) m->attacks[magic_index(m, subset)] = reference[size];
+			++size;
+			subset = (subset - m->mask) & m->mask;
+		} while (subset);
+		offset += size;
+		if (use_pext) continue;
+
+		// find a magic number that maps every subset to an index without a destructive collision
+		uint64_t seed = seeds[SQUARE_Y(sq)];
+		while (true) {
+			do {
+				m->magic = random_u64(&seed) & random_u64(&seed) & random_u64(&seed);
+			} while (bb_count((m->magic * m->mask) >> 56) < 6);
+
+			++attempt;
+			bool found = true;
+			for (size_t i = 0; i < size && found; ++i) {
+				uint64_t index = magic_index(m, occupancy[i]);
+				if (epoch[index] < attempt) {
+					epoch[index] = attempt;
+					m->attacks[index] = reference[i];
+				} else if (m->attacks[index] != reference[i]) {
+					found = false;
+				}
+			}
+			if (found) break;
+		}
+	}
+}
+
+static void init_tables(void) {
+	const struct position knight[8] = {
+	        {1,  2 },
+	        {2,  1 },
+	        {2,  -1},
+	        {1,  -2},
+	        {-1, -2},
+	        {-2, -1},
+	        {-2, 1 },
+	        {-1, 2 }
+    };
+	const struct position white_pawn[2] = {
+	        {-1, 1},
+	        {1,  1}
+    };
+	const struct position black_pawn[2] = {
+	        {-1, -1},
+	        {1,  -1}
+    };
+
+	for (uint8_t sq = 0; sq < 64; ++sq) {
+		knight_attacks[sq] = offsets_to_bitboard(sq, knight, 8);
+		king_attacks[sq] = offsets_to_bitboard(sq, ray_directions, 8);
+		pawn_attacks[COLOR_WHITE][sq] = offsets_to_bitboard(sq, white_pawn, 2);
+		pawn_attacks[COLOR_BLACK][sq] = offsets_to_bitboard(sq, black_pawn, 2);
+
+		for (uint8_t d = 0; d < 8; ++d) {
+			uint64_t ray = 0;
+			int8_t x = SQUARE_X(sq), y = SQUARE_Y(sq);
+			while (true) {
+				x += ray_directions[d].x;
+				y += ray_directions[d].y;
+				if (!position_valid_xy(x, y)) break;
+				ray |= BIT(SQUARE(x, y));
+			}
+			rays[d][sq] = ray;
+		}
+	}
+
+	for (uint8_t sq = 0; sq < 64; ++sq) {
+		for (uint8_t d = 0; d < 8; ++d) {
+			// the opposite direction is four entries along
+			uint64_t line = rays[d][sq] | rays[(d + 4) % 8][sq] | BIT(sq);
+			for (uint64_t ray = rays[d][sq]; ray;) {
+				uint8_t target = bb_pop(&ray);
+				between_squares[sq][target] = rays[d][sq] & ~rays[d][target] & ~BIT(target);
+				line_through[sq][target] = line;
+			}
+		}
+	}
+
+	use_pext = cpu_has_bmi2();
+	init_slider_tables(false, bishop_magics, bishop_table);
+	init_slider_tables(true, rook_magics, rook_table);
+
+	// a fixed seed keeps keys the same between runs, so they can be stored
+	uint64_t seed = 0x9E3779B97F4A7C15ULL;
+	for (uint8_t color = 0; color < 2; ++color)
+		for (uint8_t type = TYPE_KING; type <= TYPE_PAWN; ++type)
+			for (uint8_t sq = 0; sq < 64; ++sq) zobrist_pieces[color][type][sq] = random_u64(&seed);
+	// each combination of rights gets its own key, so no rights at all is 0
+	for (uint8_t i = 1; i < 16; ++i) zobrist_castle[i] = random_u64(&seed);
+	for (uint8_t i = 0; i < 8; ++i) zobrist_en_passant[i] = random_u64(&seed);
+	zobrist_black = random_u64(&seed);
+}
+
+void bitboard_init(void) {
+	// the tables are shared by every game, so they are filled once even if several threads create games
+	static pthread_once_t once = PTHREAD_ONCE_INIT;
+	pthread_once(&once, init_tables);
+}
+
@@ -0,0 +1,103 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "chess.h"
+
+// squares are numbered a1 = 0, b1 = 1, ..., h8 = 63
+#define SQUARE(x_, y_) ((uint8_t) ((y_) * CHESS_BOARD_WIDTH + (x_)))
+#define SQUARE_POS(pos_) SQUARE((pos_).x, (pos_).y)
+#define SQUARE_X(sq_) ((int8_t) ((sq_) % CHESS_BOARD_WIDTH))
+#define SQUARE_Y(sq_) ((int8_t) ((sq_) / CHESS_BOARD_WIDTH))
+#define SQUARE_TO_POS(sq_) POS(SQUARE_X(sq_), SQUARE_Y(sq_))
+#define BIT(sq_) ((uint64_t) 1 << (sq_))
+
+#define BB_FILE_A (0x0101010101010101ULL)
+#define BB_FILE_H (BB_FILE_A << 7)
+#define BB_RANK_1 (0xFFULL)
+#define BB_RANK_8 (BB_RANK_1 << 56)
+#define BB_LIGHT_SQUARES (0x55AA55AA55AA55AAULL)
+
+static inline uint8_t bb_count(uint64_t bb) {
+	return (uint8_t) __builtin_popcountll(bb);
+}
+
+static inline uint8_t bb_first(uint64_t bb) {
+	// index of the lowest set bit, bb must not be empty
+	return (uint8_t) __builtin_ctzll(bb);
+}
+
+static inline uint8_t bb_pop(uint64_t *bb) {
+	// remove and return the lowest set bit
+	uint8_t sq = bb_first(*bb);
+	*bb &= *bb - 1;
+	return sq;
+}
+
+extern uint64_t knight_attacks[64];
+extern uint64_t king_attacks[64];
+extern uint64_t pawn_attacks[2][64]; // squares attacked by a pawn of the given color
+extern uint64_t between_squares[64][64]; // squares strictly between two squares on the same line, otherwise empty
+extern uint64_t line_through[64][64];    // the whole line through two squares on the same line, otherwise empty
+
+// sliding piece attacks are looked up by hashing the relevant blockers into a per square table
+// the hash is either a magic multiplication or, on CPUs with BMI2, a PEXT of the blocker mask
+struct magic {
+	uint64_t mask; // relevant blockers, excludes the board edges
+	uint64_t magic;
+	uint64_t *attacks;
+	uint8_t shift;
+};
+
+extern struct magic bishop_magics[64];
+extern struct magic rook_magics[64];
+extern bool use_pext;
+
+// random keys xored together to hash a position, see compute_key
+extern uint64_t zobrist_pieces[2][TYPE_PAWN + 1][64]; // indexed by color, enum piece_type and square
+extern uint64_t zobrist_castle[16];                   // indexed by white's castling rights | black's << 2
+extern uint64_t zobrist_en_passant[8];                // indexed by the file of the en passant target
+extern uint64_t zobrist_black;                        // black to move
+
+void bitboard_init(void);
+
+static inline uint64_t magic_index(const struct magic *m, uint64_t occupied) {
+#if defined(__x86_64__)
+	if (use_pext) {
+		// inline assembly so the instruction can be used without compiling the whole file for BMI2
+		uint64_t index;
+		__asm__("pextq %2, %1, %0" : "=r"(index) : "r"(occupied), "rm"(m->mask));
+		return index;
+	}
+#endif
+	return ((occupied & m->mask) * m->magic) >> m->shift;
+}
+
+static inline uint64_t bishop_attacks(uint8_t sq, uint64_t occupied) {
+	const struct magic *m = &bishop_magics[sq];
+	return m->attacks[magic_index(m, occupied)];
+}
+
+static inline uint64_t rook_attacks(uint8_t sq, uint64_t occupied) {
+	const struct magic *m = &rook_magics[sq];
+	return m->attacks[magic_index(m, occupied)];
+}
+
+static inline uint64_t queen_attacks(uint8_t sq, uint64_t occupied) {
+	return bishop_attacks(sq, occupied) | rook_attacks(sq, occupied);
+}
+
+static inline uint64_t attackers_to(const struct game *game, uint8_t sq, uint64_t occupied) {
+	// pieces of either color attacking a square, found by looking outwards from the square with each piece's pattern
+	// sliders are found through the given occupancy, so pieces can be removed from it to look through them
+	uint64_t bishops = game->pieces[TYPE_BISHOP] | game->pieces[TYPE_QUEEN];
+	uint64_t rooks = game->pieces[TYPE_ROOK] | game->pieces[TYPE_QUEEN];
+	return (pawn_attacks[COLOR_BLACK][sq] & game->pieces[TYPE_PAWN] & game->colors[COLOR_WHITE]) |
+	       (pawn_attacks[COLOR_WHITE][sq] & game->pieces[TYPE_PAWN] & game->colors[COLOR_BLACK]) |
+	       (knight_attacks[sq] & game->pieces[TYPE_KNIGHT]) |
+	       (king_attacks[sq] & game->pieces[TYPE_KING]) |
+	       (bishop_attacks(sq, occupied) & bishops & occupied) |
+	       (rook_attacks(sq, occupied) & rooks & occupied);
+}
+#endif
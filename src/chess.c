@@ -1,7 +1,11 @@
 #include "chess.h"
+#include "bitboard.h"
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef CHESS_HASH_CHECK
+#include <assert.h>
+#endif
 
 char piece_to_char(enum piece_type type, bool lowercase) {
 	char c = '\x00';
@@ -88,27 +92,65 @@ enum piece_color get_opposite_color(enum piece_color color) {
 	return color == COLOR_WHITE ? COLOR_BLACK : COLOR_WHITE;
 }
 
+void clear_move_text(struct game *game) {
+	// the buffer is kept for the next game
+	game->move_text_length = 0;
+	if (game->move_text) game->move_text[0] = '\0';
+}
+
+static bool append_move_text(struct game *game, const char *text, size_t length) {
+	if (game->move_text_length + length + 1 > game->move_text_capacity) {
+		// the allocator has no realloc, so grow by doubling into a new buffer
+		size_t capacity = game->move_text_capacity ? game->move_text_capacity : 256;
+		while (game->move_text_length + length + 1 > capacity) capacity *= 2;
+		char *move_text = game->malloc(capacity);
+		if (!move_text) return false;
+		if (game->move_text) memcpy(move_text, game->move_text, game->move_text_length);
+		game->free(game->move_text);
+		game->move_text = move_text;
+		game->move_text_capacity = capacity;
+	}
+	memcpy(game->move_text + game->move_text_length, text, length);
+	game->move_text_length += length;
+	game->move_text[game->move_text_length] = '\0';
+	return true;
+}
+
 struct game *create_board(void *(*malloc_)(size_t), void (*free_)(void *)) {
 	// let user provide their own malloc and free functions
 	struct game *game = malloc_(sizeof(struct game));
-	if (!game) {
-		perror("malloc");
-		exit(1);
-	}
+	if (!game) return NULL;
+	bitboard_init();
 	game->malloc = malloc_;
 	game->free = free_;
 
 	// avoid free_move_list from freeing an uninitialized pointer
 	game->move_list = NULL;
 	game->move_list_tail = NULL;
+	game->move_text = NULL;
+	game->move_text_capacity = 0;
 	board_init(game);
 	return game;
 }
 
+struct game *copy_board(struct game *game) {
+	// the copy gets the position and the undo stack, not the move list, so it can be used from another thread
+	struct game *copy = game->malloc(sizeof(struct game));
+	if (!copy) return NULL;
+	*copy = *game;
+	copy->move_list = NULL;
+	copy->move_list_tail = NULL;
+	copy->move_text = NULL;
+	copy->move_text_length = 0;
+	copy->move_text_capacity = 0;
+	return copy;
+}
+
 void destroy_board(struct game *game) {
 	if (!game) return;
 
 	free_move_list(game, game->move_list);
+	game->free(game->move_text);
 
 	game->free(game);
 }
@@ -117,6 +159,9 @@ void board_init(struct game *game) {
 	free_move_list(game, game->move_list);
 	game->move_list = NULL;
 	game->move_list_tail = NULL;
+	clear_move_text(game);
+	game->start_fen[0] = '\0';
+	game->undo_count = 0;
 
 	game->win = STATE_NONE;
 	// white starts first
@@ -163,10 +208,11 @@ void board_init(struct game *game) {
 						break;
 				}
 			}
-			// set the color of the piece
-			piece->color = pos.y > CHESS_BOARD_HEIGHT / 2 ? COLOR_BLACK : COLOR_WHITE;
+			// set the color of the piece, empty squares are always white
+			piece->color = pos.y > CHESS_BOARD_HEIGHT / 2 && piece->type != TYPE_NONE ? COLOR_BLACK : COLOR_WHITE;
 		}
 	}
+	update_bitboards(game);
 }
 
 static int8_t abs8(int8_t x) {
@@ -181,31 +227,6 @@ static uint8_t log10_8(int8_t x) {
 	return log;
 }
 
-static int8_t sign(int8_t x) {
-	if (x > 0) return 1;
-	if (x < 0) return -1;
-	return 0;
-}
-
-static struct position get_direction(struct position from, struct position to) {
-	// returns a vector representing the direction from one position to another
-	// does not work for the same position or for an angle that is not a multiple of 45°
-	struct position delta = {to.x - from.x, to.y - from.y};
-	// no direction if the positions are the same
-	if (delta.x == 0 && delta.y == 0) goto none;
-	// invalid if positions are not on the same rank, file, or diagonal
-	if (delta.x != 0 && delta.y != 0)
-		if (delta.x != delta.y && delta.x != -delta.y) goto none;
-	// normalize the direction
-	delta.x = sign(delta.x);
-	delta.y = sign(delta.y);
-	return delta;
-none:
-	delta.x = 0;
-	delta.y = 0;
-	return delta;
-}
-
 bool position_equal(struct position a, struct position b) {
 	return a.x == b.x && a.y == b.y;
 }
@@ -229,18 +250,76 @@ struct piece *get_piece(struct game *game, struct position pos) {
 	return get_piece_xy(game, pos.x, pos.y);
 }
 
-static bool loop_pieces_between(struct position from, struct position to, bool (*callback)(struct position, struct game *, struct position from, struct position to, void *), struct game *game, void *data) {
-	// loop through all pieces between two positions, including the start and end positions
-	struct position pos = from;
-	struct position direction = get_direction(from, to);
-	if (direction.x == 0 && direction.y == 0) return false;
-	while (true) {
-		if (!position_valid(pos)) return false;
-		if (!callback(pos, game, from, to, data)) return false;
-		if (position_equal(pos, to)) return true;
-		pos.x += direction.x;
-		pos.y += direction.y;
+void update_bitboards(struct game *game) {
+	// rebuild the bitboards from the board array
+	memset(game->pieces, 0, sizeof(game->pieces));
+	memset(game->colors, 0, sizeof(game->colors));
+	memset(game->piece_count, 0, sizeof(game->piece_count));
+	for (uint8_t sq = 0; sq < 64; ++sq) {
+		struct piece piece = game->board[SQUARE_Y(sq)][SQUARE_X(sq)];
+		if (piece.type == TYPE_NONE) continue;
+		game->pieces[piece.type] |= BIT(sq);
+		game->colors[piece.color] |= BIT(sq);
+		++game->piece_count[piece.color][piece.type];
+	}
+	game->occupied = game->colors[COLOR_WHITE] | game->colors[COLOR_BLACK];
+	game->attacked_valid = 0;
+	game->key = compute_key(game);
+}
+
+static uint64_t castle_key(struct game *game) {
+	return zobrist_castle[game->castle_availability[COLOR_WHITE] | game->castle_availability[COLOR_BLACK] << 2];
+}
+
+static uint64_t en_passant_key(struct game *game) {
+	// the target is only hashed if a pawn can capture onto it, otherwise the position is the same as without it
+	struct position target = game->en_passant_target;
+	if (target.y != 2 && target.y != CHESS_BOARD_HEIGHT - 3) return 0;
+	enum piece_color player = game->active_color;
+	uint64_t pawns = game->pieces[TYPE_PAWN] & game->colors[player];
+	if (!(pawn_attacks[get_opposite_color(player)][SQUARE_POS(target)] & pawns)) return 0;
+	return zobrist_en_passant[target.x];
+}
+
+uint64_t compute_key(struct game *game) {
+	uint64_t key = castle_key(game) ^ en_passant_key(game);
+	if (game->active_color == COLOR_BLACK) key ^= zobrist_black;
+	for (uint64_t occupied = game->occupied; occupied;) {
+		uint8_t sq = bb_pop(&occupied);
+		struct piece piece = game->board[SQUARE_Y(sq)][SQUARE_X(sq)];
+		key ^= zobrist_pieces[piece.color][piece.type][sq];
 	}
+	return key;
+}
+
+static void remove_piece(struct game *game, uint8_t sq) {
+	struct piece *piece = &game->board[SQUARE_Y(sq)][SQUARE_X(sq)];
+	if (piece->type == TYPE_NONE) return;
+	game->key ^= zobrist_pieces[piece->color][piece->type][sq];
+	--game->piece_count[piece->color][piece->type];
+	game->pieces[piece->type] &= ~BIT(sq);
+	game->colors[piece->color] &= ~BIT(sq);
+	game->occupied &= ~BIT(sq);
+	*piece = (struct piece){TYPE_NONE, COLOR_WHITE};
+}
+
+static void place_piece(struct game *game, uint8_t sq, struct piece piece) {
+	// replaces any piece already on the square
+	remove_piece(game, sq);
+	game->board[SQUARE_Y(sq)][SQUARE_X(sq)] = piece;
+	if (piece.type == TYPE_NONE) return;
+	game->key ^= zobrist_pieces[piece.color][piece.type][sq];
+	++game->piece_count[piece.color][piece.type];
+	game->pieces[piece.type] |= BIT(sq);
+	game->colors[piece.color] |= BIT(sq);
+	game->occupied |= BIT(sq);
+}
+
+static uint64_t en_passant_bitboard(struct game *game) {
+	// (0, 0) means there is no target, a valid target is always on the third or sixth rank
+	struct position target = game->en_passant_target;
+	if (target.y != 2 && target.y != CHESS_BOARD_HEIGHT - 3) return 0;
+	return BIT(SQUARE_POS(target));
 }
 
 // shorthand function
@@ -248,34 +327,71 @@ static bool match_piece(struct piece *piece, enum piece_type type, enum piece_co
 	return piece && piece->type == type && piece->color == color;
 }
 
+// fixed size output for move generation
+struct move_buffer {
+	uint16_t *moves;
+	size_t count, capacity;
+};
+
 // internal functions for move handling
-static struct move_list *get_available_moves_internal(struct game *game, enum piece_color player, bool check_threat);
-static bool perform_move_internal(struct game *game, struct move move);
+static size_t generate_moves_internal(struct game *game, enum piece_color player, struct move_buffer *buffer, uint64_t from_mask, enum move_stage stage);
+
+bool square_attacked_by(struct game *game, struct position pos, enum piece_color color) {
+	if (!position_valid(pos)) return false;
+	return (attackers_to(game, SQUARE_POS(pos), game->occupied) & game->colors[color]) != 0;
+}
+
+uint64_t get_attacked_squares(struct game *game, enum piece_color color) {
+	// cached until the position changes
+	if (game->attacked_valid & (1 << color)) return game->attacked[color];
+	uint64_t pieces = game->colors[color];
+	uint64_t attacked = 0;
+	while (pieces) {
+		uint8_t sq = bb_pop(&pieces);
+		switch (game->board[SQUARE_Y(sq)][SQUARE_X(sq)].type) {
+			case TYPE_PAWN:
+				attacked |= pawn_attacks[color][sq];
+				break;
+			case TYPE_KNIGHT:
+				attacked |= knight_attacks[sq];
+				break;
+			case TYPE_BISHOP:
+				attacked |= bishop_attacks(sq, game->occupied);
+				break;
+			case TYPE_ROOK:
+				attacked |= rook_attacks(sq, game->occupied);
+				break;
+			case TYPE_QUEEN:
+				attacked |= queen_attacks(sq, game->occupied);
+				break;
+			case TYPE_KING:
+				attacked |= king_attacks[sq];
+				break;
+			default:
+				break;
+		}
+	}
+	game->attacked[color] = attacked;
+	game->attacked_valid |= 1 << color;
+	return attacked;
+}
 
 static bool get_if_check(struct game *game, enum piece_color player) {
 	// check if the player is in check
-	// more specifically, if the opponent can "capture" the player's king
-	struct move_list *moves_ = get_available_moves_internal(game, get_opposite_color(player), true);
-	for (struct move_list *moves = moves_->next;
-	     moves; moves = moves->next) {
-		// ignore castling since they cannot capture a piece
-		if (moves->move.type == MOVE_CASTLE) continue;
-		struct piece *to = get_piece(game, moves->move.to);
-		if (!match_piece(to, TYPE_KING, player)) continue;
-		// if the opponent can take the player's king, the player is in check
-		free_move_list(game, moves_);
-		return true;
-	}
-	free_move_list(game, moves_);
-	return false;
+	uint64_t king = game->pieces[TYPE_KING] & game->colors[player];
+	if (!king) return false;
+	return (attackers_to(game, bb_first(king), game->occupied) & game->colors[get_opposite_color(player)]) != 0;
+}
+
+bool in_check(struct game *game) {
+	return get_if_check(game, game->active_color);
 }
 
 struct move_state get_move_state(struct game *game, enum piece_color player) {
 	struct move_state state = {.check = false};
 	// if the player has no legal moves, the game is in stalemate
-	struct move_list *moves = get_available_moves_internal(game, player, false);
-	state.stalemate = !moves->next;
-	free_move_list(game, moves);
+	uint16_t moves[CHESS_MAX_MOVES];
+	state.stalemate = generate_moves_internal(game, player, &(struct move_buffer){moves, 0, CHESS_MAX_MOVES}, ~0ULL, MOVES_ALL) == 0;
 	// check if the player is in check
 	state.check = get_if_check(game, player);
 	// checkmate occurs if the player is in check and has no legal moves
@@ -284,10 +400,7 @@ struct move_state get_move_state(struct game *game, enum piece_color player) {
 
 static struct move_list *alloc_move(struct game *game) {
 	struct move_list *new = game->malloc(sizeof(struct move_list));
-	if (!new) {
-		perror("malloc");
-		exit(1);
-	}
+	if (!new) return NULL;
 	new->next = NULL;
 	return new;
 }
@@ -295,6 +408,7 @@ static struct move_list *alloc_move(struct game *game) {
 struct move_list *add_move(struct game *game, struct move_list *list, struct move move) {
 	// add the move to the start of the list
 	struct move_list *new = alloc_move(game);
+	if (!new) return NULL;
 	new->move = move;
 
 	// insert new node after the current node
@@ -304,377 +418,409 @@ struct move_list *add_move(struct game *game, struct move_list *list, struct mov
 	return new;
 }
 
-static void add_move_list_end(struct game *game, struct move move) {
+static bool add_move_list_end(struct game *game, struct move move) {
 	// add the move to the end of the list
-	if (game->move_list_tail) {
-		game->move_list_tail = add_move(game, game->move_list_tail, move);
-		return;
-	}
-	game->move_list = alloc_move(game);
-	game->move_list->move = move;
-	game->move_list_tail = game->move_list;
-}
-
-static void search_moves(struct game *game, struct move_list *list, struct position pos, bool cardinal, bool diagonal, uint8_t max_length) {
-	// combine arrays into one
-	struct position directions[8];
-	memset(directions, 0, sizeof(directions));
-	if (cardinal) {
-		directions[0] = POS(0, 1);
-		directions[1] = POS(1, 0);
-		directions[2] = POS(0, -1);
-		directions[3] = POS(-1, 0);
-	}
-	if (diagonal) {
-		directions[4] = POS(1, 1);
-		directions[5] = POS(1, -1);
-		directions[6] = POS(-1, -1);
-		directions[7] = POS(-1, 1);
-	}
-	// loop all directions
-	for (uint8_t i = 0; i < sizeof(directions) / sizeof(directions[0]); ++i) {
-		struct position direction = directions[i];
-		if (direction.x == 0 && direction.y == 0) continue;
-		struct position new_pos = pos;
-		for (uint8_t distance = 0; max_length == 0 || distance < max_length; ++distance) {
-			new_pos.x += direction.x;
-			new_pos.y += direction.y;
-
-			struct piece *piece = get_piece(game, new_pos);
-			if (!piece) break;
-
-			if (piece->type != TYPE_NONE) {
-				// stop searching if there is a same colored piece in the way
-				if (piece->color == game->active_color) break;
-			}
-			add_move(game, list, MOVE(pos, new_pos));
-
-			// stop searching if there is the opponent's piece in the way
-			if (piece->type != TYPE_NONE) break;
-		}
-	}
-}
-
-static bool castle_check_empty_callback(struct position pos, struct game *game, struct position from, struct position to, void *data) {
-	(void) data;
-	// obviously the king and rook positions are not empty
-	if (position_equal(pos, from)) return true;
-	if (position_equal(pos, to)) return true;
-
-	// every other piece between them must be empty though
-	struct piece *piece = get_piece(game, pos);
-	if (!piece) return false;
-	if (piece->type != TYPE_NONE) return false; // break if there is a piece in the way
+	struct move_list *new = game->move_list_tail ? add_move(game, game->move_list_tail, move) : alloc_move(game);
+	if (!new) return false;
+	new->move = move;
+	if (!game->move_list) game->move_list = new;
+	game->move_list_tail = new;
 	return true;
 }
 
-static bool castle_check_no_attack_callback(struct position pos, struct game *game, struct position from, struct position to, void *data) {
-	(void) from;
-	(void) to;
-	struct piece *piece = get_piece(game, pos);
-	if (!piece) return false;
-
-	// the tiles the king moves through must not be under attack
-	struct move_list *moves_ = get_available_moves_internal(game, get_opposite_color((enum piece_color) data), true);
-	for (struct move_list *moves = moves_->next;
-	     moves; moves = moves->next) {
-		if (moves->move.type == MOVE_CASTLE) continue;
-		if (!position_equal(moves->move.to, pos)) continue;
-		free_move_list(game, moves_);
-		return false;
-	}
-	free_move_list(game, moves_);
-	return true;
+static void push_move(struct move_buffer *buffer, uint16_t move) {
+	// moves past the end of the buffer are dropped, no position has more than 218 legal moves
+	if (buffer->count < buffer->capacity) buffer->moves[buffer->count++] = move;
 }
 
-static void find_castle_moves(struct game *game, struct move_list *list, enum piece_color player) {
+static void find_castle_moves(struct game *game, struct move_buffer *buffer, enum piece_color player) {
 	// get positions of the king and rooks
 	struct position king = POS(CHESS_BOARD_WIDTH - 4, player == COLOR_WHITE ? 0 : CHESS_BOARD_HEIGHT - 1);
 	struct position rook_king_side = POS(CHESS_BOARD_WIDTH - 1, king.y);
 	struct position rook_queen_side = POS(0, king.y);
-	// destination positions
-	struct position destination_king_side = POS(king.x + 2, king.y);
-	struct position destination_queen_side = POS(king.x - 2, king.y);
-
 	// get pieces
 	struct piece *king_piece = get_piece(game, king);
 
 	// check if the pieces are the correct type
+	if (!game->castle_availability[player]) return;
 	if (!match_piece(king_piece, TYPE_KING, player)) return;
-
-	if ((game->castle_availability[player] & GAME_CASTLE_KING_SIDE) == GAME_CASTLE_KING_SIDE)
+	uint64_t rooks = game->pieces[TYPE_ROOK] & game->colors[player];
+
+	// squares between the king and each rook
+	uint8_t king_sq = SQUARE_POS(king);
+	uint64_t between_king_side = BIT(king_sq + 1) | BIT(king_sq + 2);
+	uint64_t between_queen_side = BIT(king_sq - 1) | BIT(king_sq - 2) | BIT(king_sq - 3);
+	// squares the king moves through, including where it starts and ends
+	uint64_t path_king_side = BIT(king_sq) | between_king_side;
+	uint64_t path_queen_side = BIT(king_sq) | BIT(king_sq - 1) | BIT(king_sq - 2);
+	uint64_t attacked = get_attacked_squares(game, get_opposite_color(player));
+
+	if ((game->castle_availability[player] & GAME_CASTLE_KING_SIDE) == GAME_CASTLE_KING_SIDE && (rooks & BIT(SQUARE_POS(rook_king_side))))
 		// confirm there are no pieces between the king and rook
-		if (loop_pieces_between(king, rook_king_side, castle_check_empty_callback, game, (void *) player))
+		if (!(game->occupied & between_king_side))
 			// confirm the tiles the king moves through are not under attack
-			if (loop_pieces_between(king, destination_king_side, castle_check_no_attack_callback, game, (void *) player))
+			if (!(attacked & path_king_side))
 				// add the move to the list
-				add_move(game, list, (struct move){.type = MOVE_CASTLE, .castle = KING_SIDE});
+				push_move(buffer, PACKED_MOVE(king_sq, king_sq + 2, MOVE_FLAG_CASTLE_KING));
 
-	if ((game->castle_availability[player] & GAME_CASTLE_QUEEN_SIDE) == GAME_CASTLE_QUEEN_SIDE)
+	if ((game->castle_availability[player] & GAME_CASTLE_QUEEN_SIDE) == GAME_CASTLE_QUEEN_SIDE && (rooks & BIT(SQUARE_POS(rook_queen_side))))
 		// confirm there are no pieces between the king and rook
-		if (loop_pieces_between(king, rook_queen_side, castle_check_empty_callback, game, (void *) player))
+		if (!(game->occupied & between_queen_side))
 			// confirm the tiles the king moves through are not under attack
-			if (loop_pieces_between(king, destination_queen_side, castle_check_no_attack_callback, game, (void *) player))
+			if (!(attacked & path_queen_side))
 				// add the move to the list
-				add_move(game, list, (struct move){.type = MOVE_CASTLE, .castle = QUEEN_SIDE});
-}
-
-static void filter_moves(struct game *game, struct move_list *list, enum piece_color player, bool (*callback)(struct game *, struct move_list *, enum piece_color, void *), void *data) {
-	for (struct move_list *previous = list;; previous = previous->next) {
-	next:;
-		struct move_list *current = previous->next;
-		if (!current) break;
-		if (!callback(game, current, player, data)) {
-			// remove the move from the list
-			previous->next = current->next;
-			game->free(current);
-			goto next; // avoid skipping the next one because previous->next has already been changed
-		}
-	}
+				push_move(buffer, PACKED_MOVE(king_sq, king_sq - 2, MOVE_FLAG_CASTLE_QUEEN));
 }
 
-static bool filter_valid_moves(struct game *game, struct move_list *list, enum piece_color player, void *data) {
-	struct move_list *end = (struct move_list *) data;
-	struct move *move = &list->move;
-	if (move->type == MOVE_CASTLE) return true;
-	struct piece *from = get_piece(game, move->from);
-	struct piece *to = get_piece(game, move->to);
-	if (!from) return false;
-	if (!to) return false; // cannot move to an invalid position
-	if (to->type != TYPE_NONE) {
-		if (to->color == player) return false;
-		move->type = MOVE_CAPTURE; // set the move type to capture
-	}
-	if (from->type == TYPE_PAWN) {
-		if (position_equal(game->en_passant_target, move->to)) {
-			move->type = MOVE_CAPTURE;
-			move->en_passant = true;
-		}
-		if (move->to.y == 0 || move->to.y == CHESS_BOARD_HEIGHT - 1) {
-			// important: this code MUST be after the en passant check since en_passant and promote_to are in the same union
-			if (move->type == MOVE_CAPTURE)
-				move->type = MOVE_CAPTURE_PROMOTION;
-			else
-				move->type = MOVE_PROMOTION;
-			// add all possible promotions to end of list which isn't filtered to avoid infinite loop
-			// for some reason, checking to see if move->type is already set doesn't work
-			move->promote_to = TYPE_QUEEN;
-			add_move(game, end, *move);
-			move->promote_to = TYPE_ROOK;
-			add_move(game, end, *move);
-			move->promote_to = TYPE_BISHOP;
-			add_move(game, end, *move);
-			move->promote_to = TYPE_KNIGHT;
-		}
+static uint64_t piece_attacks(enum piece_type type, uint8_t sq, uint64_t occupied) {
+	// squares a piece other than a pawn attacks from a square
+	switch (type) {
+		case TYPE_KNIGHT:
+			return knight_attacks[sq];
+		case TYPE_BISHOP:
+			return bishop_attacks(sq, occupied);
+		case TYPE_ROOK:
+			return rook_attacks(sq, occupied);
+		case TYPE_QUEEN:
+			return queen_attacks(sq, occupied);
+		case TYPE_KING:
+			return king_attacks[sq];
+		default:
+			return 0;
 	}
-	return true;
-}
-
-static bool map_legal_moves(struct game *game, struct move_list *list, enum piece_color player, void *data) {
-	// does not actually remove legal moves, just sets the flag if the move is legal or not
-	(void) data;
-	struct move *move = &list->move;
-	// check if the move puts the player in check
-	struct game game_copy = *game;
-	move->legal = true;
-	if (!perform_move_internal(&game_copy, *move)) return false;
-	move->legal = !get_if_check(&game_copy, player);
-	return true;
-}
-
-static bool filter_legal_moves(struct game *game, struct move_list *list, enum piece_color player, void *data) {
-	(void) player;
-	(void) game;
-	(void) data;
-	return list->move.legal;
-}
-
-static bool map_move_state(struct game *game, struct move_list *list, enum piece_color player, void *data) {
-	(void) data;
-	// annotate check/stalemate/checkmate for the other player
-	struct game game_copy = *game;
-
-	if (!perform_move_internal(&game_copy, list->move))
-		return false;
-
-	struct move_state state = get_move_state(&game_copy, get_opposite_color(player));
-	list->move.state = state;
-
-	return true;
 }
 
-static bool annotate_moves(struct game *game, struct move_list *list, enum piece_color player, void *data) {
-	(void) player;
-	struct move *move = &list->move;
-	if (!move->legal) return true;
-
-	char *notation = move->notation;
+void move_to_san(struct game *game, uint16_t move, char *notation) {
+	uint8_t from = PACKED_FROM(move), to = PACKED_TO(move), flags = PACKED_FLAGS(move);
 	uint8_t i = 0;
 
-	struct piece *from = get_piece(game, move->from);
-	bool is_capture = move->type == MOVE_CAPTURE || move->type == MOVE_CAPTURE_PROMOTION;
-	bool is_pawn = from->type == TYPE_PAWN;
-
-	if (move->type == MOVE_CASTLE) {
+	if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) {
 		notation[i++] = '0';
 		// 0-0 for kingside, 0-0-0 for queenside
-		for (uint8_t j = 0; j < (move->castle == QUEEN_SIDE ? 2 : 1); ++j) {
+		for (uint8_t j = 0; j < (flags == MOVE_FLAG_CASTLE_QUEEN ? 2 : 1); ++j) {
 			notation[i++] = '-';
 			notation[i++] = '0';
 		}
 	} else {
+		enum piece_type type = game->board[SQUARE_Y(from)][SQUARE_X(from)].type;
+		bool is_capture = flags & MOVE_FLAG_CAPTURE;
+		bool is_pawn = type == TYPE_PAWN;
+
 		// add the piece type
-		if (!is_pawn) notation[i++] = piece_to_char(from->type, false);
+		if (!is_pawn) notation[i++] = piece_to_char(type, false);
 
 		// check for ambiguous source file/rank
-		struct move_list *whole_list = (struct move_list *) data;
 		bool specify_file = false, specify_rank = false;
-		for (struct move_list *m = whole_list; m; m = m->next) {
-			if (position_equal(m->move.from, move->from)) continue; // skip the current move
-			if (position_equal(m->move.to, move->to)) {
-				struct piece *other = get_piece(game, m->move.from);
-				if (other->type == from->type) {
-					if (m->move.from.x == move->from.x) specify_rank = true;
-					if (m->move.from.y == move->from.y) specify_file = true;
-					if (m->move.from.x != move->from.x && m->move.from.y != move->from.y) specify_file = true;
-				}
+		uint64_t others = game->pieces[type] & game->colors[game->active_color] & ~BIT(from);
+		// only generate the legal moves if another piece of the same type could reach the square
+		if (!is_pawn && (others & piece_attacks(type, to, game->occupied))) {
+			uint16_t moves[CHESS_MAX_MOVES];
+			size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+			for (size_t j = 0; j < count; ++j) {
+				uint8_t other = PACKED_FROM(moves[j]);
+				if (PACKED_TO(moves[j]) != to || !(others & BIT(other))) continue;
+				if (SQUARE_X(other) == SQUARE_X(from)) specify_rank = true;
+				if (SQUARE_Y(other) == SQUARE_Y(from)) specify_file = true;
+				if (SQUARE_X(other) != SQUARE_X(from) && SQUARE_Y(other) != SQUARE_Y(from)) specify_file = true;
 			}
 		}
 
 		if (is_capture && is_pawn) specify_file = true; // algebraic notation includes file if there is a capture even if it is not ambiguous
 
 		// add the source file/rank
-		if (specify_file) notation[i++] = file_to_char(move->from.x);
-		if (specify_rank) notation[i++] = rank_to_char(move->from.y);
+		if (specify_file) notation[i++] = file_to_char(SQUARE_X(from));
+		if (specify_rank) notation[i++] = rank_to_char(SQUARE_Y(from));
 
 		// add the capture symbol
 		if (is_capture) notation[i++] = 'x';
 
 		// add the destination
-		notation[i++] = file_to_char(move->to.x);
-		notation[i++] = rank_to_char(move->to.y);
+		notation[i++] = file_to_char(SQUARE_X(to));
+		notation[i++] = rank_to_char(SQUARE_Y(to));
 
 		// add the promotion annotation
-		if (move->type == MOVE_PROMOTION || move->type == MOVE_CAPTURE_PROMOTION) {
+		if (flags & MOVE_FLAG_PROMOTION) {
 			notation[i++] = '=';
-			notation[i++] = piece_to_char(move->promote_to, false);
+			notation[i++] = piece_to_char(PACKED_PROMOTION(move), false);
 		}
 	}
 
 	// add the check/checkmate annotation
-	if (move->state.check) {
-		notation[i++] = move->state.stalemate ? '#' : '+';
+	if (make_move(game, move)) {
+		if (get_if_check(game, game->active_color)) {
+			uint16_t moves[CHESS_MAX_MOVES];
+			notation[i++] = generate_packed_moves(game, moves, CHESS_MAX_MOVES) ? '+' : '#';
+		}
+		unmake_move(game);
 	}
 
 	// add the null terminator
 	notation[i] = '\0';
+}
 
-	return true;
+static void add_moves_to(struct game *game, struct move_buffer *buffer, uint8_t from, uint64_t targets) {
+	// add a move from one square to each square in the bitboard
+	while (targets) {
+		uint8_t to = bb_pop(&targets);
+		push_move(buffer, PACKED_MOVE(from, to, game->occupied & BIT(to) ? MOVE_FLAG_CAPTURE : MOVE_FLAG_QUIET));
+	}
 }
 
-static struct move_list *get_available_moves_internal(struct game *game, enum piece_color player, bool check_threat) {
-	struct move_list *list = alloc_move(game); // dummy node to simplify adding moves to the list
-	struct position pos;
-	for (pos.y = 0; pos.y < CHESS_BOARD_HEIGHT; pos.y++) {
-		for (pos.x = 0; pos.x < CHESS_BOARD_WIDTH; pos.x++) {
-			struct piece *piece = get_piece(game, pos);
-			if (!piece) continue;
-			if (piece->type == TYPE_NONE) continue;
-			if (piece->color != player) continue;
-
-			switch (piece->type) {
-				case TYPE_PAWN:;
-					int8_t direction = piece->color == COLOR_WHITE ? 1 : -1;
-					int8_t pawn_rank = piece->color == COLOR_WHITE ? 1 : CHESS_BOARD_HEIGHT - 2;
-
-					struct position forward = POS(pos.x, pos.y + direction);
-					struct position forward2 = POS(pos.x, pos.y + 2 * direction);
-					struct piece *forward_piece = get_piece(game, forward);
-					struct piece *forward2_piece = get_piece(game, forward2);
-					if (forward_piece && forward_piece->type == TYPE_NONE) {
-						// pawn can move forward
-						add_move(game, list, MOVE(pos, forward));
-						if (pawn_rank == pos.y && forward2_piece && forward2_piece->type == TYPE_NONE) {
-							// pawn can move forward two spaces if they haven't moved yet
-							add_move(game, list, MOVE(pos, forward2));
-						}
-					}
-
-					for (int8_t i = 0; i < 2; ++i) {
-						int8_t offset = i * 2 - 1;
-						struct position diagonal = POS(pos.x + offset, pos.y + direction);
-						struct piece *diagonal_piece = get_piece(game, diagonal);
-						if (!diagonal_piece) continue;
-						if ((diagonal_piece->type != TYPE_NONE && diagonal_piece->color != piece->color) || (position_equal(game->en_passant_target, diagonal))) {
-							// pawn can capture diagonally or en passant
-							add_move(game, list, MOVE(pos, diagonal));
-						}
-					}
-					break;
-				case TYPE_KNIGHT:;
-					struct position directions[8] = {
-					        {1,  2 },
-					        {2,  1 },
-					        {2,  -1},
-					        {1,  -2},
-					        {-1, -2},
-					        {-2, -1},
-					        {-2, 1 },
-					        {-1, 2 }
-                    };
-					for (uint8_t i = 0; i < sizeof(directions) / sizeof(directions[0]); ++i) {
-						add_move(game, list, MOVE(pos, POS(pos.x + directions[i].x, pos.y + directions[i].y)));
-					}
-					break;
-				case TYPE_BISHOP:
-					search_moves(game, list, pos, false, true, 0);
-					break;
-				case TYPE_ROOK:
-					search_moves(game, list, pos, true, false, 0);
-					break;
-				case TYPE_QUEEN:
-					search_moves(game, list, pos, true, true, 0);
-					break;
-				case TYPE_KING:
-					search_moves(game, list, pos, true, true, 1);
-					break;
-				default:
-					break;
-			}
+static void add_pawn_moves_to(struct game *game, struct move_buffer *buffer, uint8_t from, uint64_t targets) {
+	// same as add_moves_to, but also handles en passant and promotion
+	while (targets) {
+		uint8_t to = bb_pop(&targets);
+		uint8_t flags = MOVE_FLAG_QUIET;
+		if (game->occupied & BIT(to)) {
+			flags = MOVE_FLAG_CAPTURE;
+		} else if (SQUARE_X(from) != SQUARE_X(to)) {
+			// diagonal move to an empty square
+			flags = MOVE_FLAG_EN_PASSANT;
 		}
+		if (BIT(to) & (BB_RANK_1 | BB_RANK_8)) {
+			flags |= MOVE_FLAG_PROMOTION;
+			const enum piece_type promotions[] = {TYPE_QUEEN, TYPE_ROOK, TYPE_BISHOP, TYPE_KNIGHT};
+			for (uint8_t i = 0; i < sizeof(promotions) / sizeof(promotions[0]); ++i)
+				push_move(buffer, PACKED_MOVE(from, to, flags | (promotions[i] - TYPE_QUEEN)));
+			continue;
+		}
+		push_move(buffer, PACKED_MOVE(from, to, flags));
 	}
+}
 
-	// create temp list to avoid infinite loop in filter_valid_moves
-	struct move_list *end = alloc_move(game);
-	end->next = NULL;
-	filter_moves(game, list, player, filter_valid_moves, end);
-	for (struct move_list *m = list; m; m = m->next) {
-		if (!m->next) {
-			// found end, add the moves from the temp list
-			m->next = end->next;
-			break;
+static uint64_t get_pinned(struct game *game, enum piece_color player, uint8_t king) {
+	// pieces that cannot leave the line between their king and an opponent's slider
+	uint64_t opponent = game->colors[get_opposite_color(player)];
+	uint64_t snipers = (rook_attacks(king, 0) & (game->pieces[TYPE_ROOK] | game->pieces[TYPE_QUEEN]) & opponent) |
+	                   (bishop_attacks(king, 0) & (game->pieces[TYPE_BISHOP] | game->pieces[TYPE_QUEEN]) & opponent);
+	uint64_t pinned = 0;
+	while (snipers) {
+		uint64_t blockers = between_squares[king][bb_pop(&snipers)] & game->occupied;
+		// pinned if there is exactly one piece in the way and it is the player's
+		if (blockers && !(blockers & (blockers - 1))) pinned |= blockers & game->colors[player];
+	}
+	return pinned;
+}
+
+static bool en_passant_legal(struct game *game, enum piece_color player, uint8_t king, uint8_t from, uint8_t to) {
+	// both pawns leave the rank at once, so the usual pin test misses a slider on that rank
+	// instead remove them from the board and look for any slider that can see the king
+	uint64_t opponent = game->colors[get_opposite_color(player)];
+	uint8_t captured = SQUARE(SQUARE_X(to), SQUARE_Y(from));
+	uint64_t occupied = (game->occupied ^ BIT(from) ^ BIT(captured)) | BIT(to);
+	if (bishop_attacks(king, occupied) & (game->pieces[TYPE_BISHOP] | game->pieces[TYPE_QUEEN]) & opponent) return false;
+	if (rook_attacks(king, occupied) & (game->pieces[TYPE_ROOK] | game->pieces[TYPE_QUEEN]) & opponent) return false;
+	// any other checker must be the captured pawn
+	uint64_t checkers = attackers_to(game, king, game->occupied) & opponent;
+	return !(checkers & ~BIT(captured));
+}
+
+static size_t generate_moves_internal(struct game *game, enum piece_color player, struct move_buffer *buffer, uint64_t from_mask, enum move_stage stage) {
+	// only legal moves are generated, checks and pins are found once for the whole position
+	// only pieces in from_mask are moved, and the stage picks captures, quiet moves or both
+	uint64_t own = game->colors[player];
+	uint64_t opponent = game->colors[get_opposite_color(player)];
+	uint64_t promotion_ranks = BB_RANK_1 | BB_RANK_8;
+	uint64_t en_passant_target = en_passant_bitboard(game);
+	// squares each kind of piece may move to in this stage, pawns also capture en passant and count every promotion as a capture
+	uint64_t stage_mask = stage == MOVES_CAPTURES ? opponent : stage == MOVES_QUIETS ? ~opponent : ~0ULL;
+	uint64_t pawn_stage_mask = stage == MOVES_CAPTURES ? opponent | en_passant_target | promotion_ranks :
+	                           stage == MOVES_QUIETS   ? ~(opponent | en_passant_target | promotion_ranks) :
+	                                                     ~0ULL;
+
+	uint64_t king_bb = game->pieces[TYPE_KING] & own;
+	uint8_t king = king_bb ? bb_first(king_bb) : 0;
+	uint64_t checkers = king_bb ? attackers_to(game, king, game->occupied) & opponent : 0;
+	uint64_t pinned = king_bb ? get_pinned(game, player, king) : 0;
+
+	// squares any piece other than the king must move to
+	uint64_t target_mask = ~own;
+	if (checkers) {
+		// capture the checker or block it, only the king can move in double check
+		if (checkers & (checkers - 1))
+			target_mask = 0;
+		else
+			target_mask &= checkers | between_squares[king][bb_first(checkers)];
+	}
+
+	for (uint64_t remaining = own & from_mask; remaining;) {
+		uint8_t from = bb_pop(&remaining);
+		enum piece_type type = game->board[SQUARE_Y(from)][SQUARE_X(from)].type;
+		uint64_t targets = 0;
+		switch (type) {
+			case TYPE_PAWN:;
+				int8_t direction = player == COLOR_WHITE ? CHESS_BOARD_WIDTH : -CHESS_BOARD_WIDTH;
+				int8_t pawn_rank = player == COLOR_WHITE ? 1 : CHESS_BOARD_HEIGHT - 2;
+
+				uint8_t forward = from + direction;
+				if (!(game->occupied & BIT(forward))) {
+					// pawn can move forward
+					targets |= BIT(forward);
+					// pawn can move forward two spaces if they haven't moved yet
+					uint8_t forward2 = forward + direction;
+					if (SQUARE_Y(from) == pawn_rank && !(game->occupied & BIT(forward2)))
+						targets |= BIT(forward2);
+				}
+				// pawn can capture diagonally
+				targets |= pawn_attacks[player][from] & opponent;
+				targets &= target_mask;
+				// or en passant, which is tested separately
+				uint64_t en_passant = pawn_attacks[player][from] & en_passant_target;
+				if (en_passant && king_bb && en_passant_legal(game, player, king, from, bb_first(en_passant)))
+					targets |= en_passant;
+				break;
+			case TYPE_KNIGHT:
+				targets = knight_attacks[from] & target_mask;
+				break;
+			case TYPE_BISHOP:
+				targets = bishop_attacks(from, game->occupied) & target_mask;
+				break;
+			case TYPE_ROOK:
+				targets = rook_attacks(from, game->occupied) & target_mask;
+				break;
+			case TYPE_QUEEN:
+				targets = queen_attacks(from, game->occupied) & target_mask;
+				break;
+			case TYPE_KING:;
+				// the king cannot move to an attacked square
+				// look through the king so it cannot step back along a checking ray
+				uint64_t king_targets = king_attacks[from] & ~own & stage_mask;
+				while (king_targets) {
+					uint8_t to = bb_pop(&king_targets);
+					if (!(attackers_to(game, to, game->occupied ^ BIT(from)) & opponent)) targets |= BIT(to);
+				}
+				add_moves_to(game, buffer, from, targets);
+				continue;
+			default:
+				break;
 		}
+		// pinned pieces can only move along the pin
+		if (pinned & BIT(from)) targets &= line_through[king][from];
+		if (type == TYPE_PAWN)
+			add_pawn_moves_to(game, buffer, from, targets & pawn_stage_mask);
+		else
+			add_moves_to(game, buffer, from, targets & stage_mask);
 	}
-	game->free(end);
 
-	if (check_threat) return list; // do not bother if we are checking for check/attacks to avoid infinite recursion
+	if (!checkers && stage != MOVES_CAPTURES && (king_bb & from_mask)) find_castle_moves(game, buffer, player);
+
+	return buffer->count;
+}
 
-	find_castle_moves(game, list, player);
+size_t generate_packed_moves(struct game *game, uint16_t *buf, size_t cap) {
+	return generate_moves_internal(game, game->active_color, &(struct move_buffer){buf, 0, cap}, ~0ULL, MOVES_ALL);
+}
 
-	filter_moves(game, list, player, map_legal_moves, NULL);
-	return list;
+size_t generate_staged_moves(struct game *game, enum move_stage stage, uint16_t *buf, size_t cap) {
+	return generate_moves_internal(game, game->active_color, &(struct move_buffer){buf, 0, cap}, ~0ULL, stage);
 }
 
-struct move_list *get_legal_moves(struct game *game) {
-	struct move_list *list = get_available_moves_internal(game, game->active_color, false);
-	filter_moves(game, list, game->active_color, filter_legal_moves, NULL);
-	filter_moves(game, list, game->active_color, map_move_state, NULL);
-	filter_moves(game, list, game->active_color, annotate_moves, (void *) list->next);
+bool is_legal_move(struct game *game, uint16_t move) {
+	// only the moves of the piece on the from square are generated
+	if (!move) return false;
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_moves_internal(game, game->active_color, &(struct move_buffer){moves, 0, CHESS_MAX_MOVES}, BIT(PACKED_FROM(move)), MOVES_ALL);
+	for (size_t i = 0; i < count; ++i)
+		if (moves[i] == move) return true;
+	return false;
+}
+
+size_t generate_moves(struct game *game, struct move *buf, size_t cap) {
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, cap < CHESS_MAX_MOVES ? cap : CHESS_MAX_MOVES);
+	for (size_t i = 0; i < count; ++i) buf[i] = unpack_move(moves[i]);
+	return count;
+}
+
+uint16_t pack_move(struct game *game, struct move move) {
+	if (move.type == MOVE_CASTLE) {
+		// castling is stored as the king's move
+		uint8_t king = SQUARE(CHESS_BOARD_WIDTH - 4, game->active_color == COLOR_WHITE ? 0 : CHESS_BOARD_HEIGHT - 1);
+		if (move.castle == KING_SIDE) return PACKED_MOVE(king, king + 2, MOVE_FLAG_CASTLE_KING);
+		return PACKED_MOVE(king, king - 2, MOVE_FLAG_CASTLE_QUEEN);
+	}
+	uint8_t flags = MOVE_FLAG_QUIET;
+	switch (move.type) {
+		case MOVE_CAPTURE:
+			flags = move.en_passant ? MOVE_FLAG_EN_PASSANT : MOVE_FLAG_CAPTURE;
+			break;
+		case MOVE_PROMOTION:
+			flags = MOVE_FLAG_PROMOTION | (move.promote_to - TYPE_QUEEN);
+			break;
+		case MOVE_CAPTURE_PROMOTION:
+			flags = MOVE_FLAG_CAPTURE | MOVE_FLAG_PROMOTION | (move.promote_to - TYPE_QUEEN);
+			break;
+		default:
+			break;
+	}
+	return PACKED_MOVE(SQUARE_POS(move.from), SQUARE_POS(move.to), flags);
+}
+
+struct move unpack_move(uint16_t packed) {
+	struct move move = {.legal = true, .type = MOVE_REGULAR};
+	uint8_t flags = PACKED_FLAGS(packed);
+	if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) {
+		move.type = MOVE_CASTLE;
+		move.castle = flags == MOVE_FLAG_CASTLE_KING ? KING_SIDE : QUEEN_SIDE;
+		return move;
+	}
+	move.from = SQUARE_TO_POS(PACKED_FROM(packed));
+	move.to = SQUARE_TO_POS(PACKED_TO(packed));
+	if (flags & MOVE_FLAG_PROMOTION) {
+		move.type = flags & MOVE_FLAG_CAPTURE ? MOVE_CAPTURE_PROMOTION : MOVE_PROMOTION;
+		move.promote_to = PACKED_PROMOTION(packed);
+	} else if (flags & MOVE_FLAG_CAPTURE) {
+		move.type = MOVE_CAPTURE;
+		move.en_passant = flags == MOVE_FLAG_EN_PASSANT;
+	}
+	return move;
+}
+
+void move_to_uci(uint16_t move, char *notation) {
+	// from and to squares, castling is written as the king's move
+	uint8_t i = 0;
+	notation[i++] = file_to_char(SQUARE_X(PACKED_FROM(move)));
+	notation[i++] = rank_to_char(SQUARE_Y(PACKED_FROM(move)));
+	notation[i++] = file_to_char(SQUARE_X(PACKED_TO(move)));
+	notation[i++] = rank_to_char(SQUARE_Y(PACKED_TO(move)));
+	if (PACKED_FLAGS(move) & MOVE_FLAG_PROMOTION) notation[i++] = piece_to_char(PACKED_PROMOTION(move), true);
+	notation[i] = '\0';
+}
+
+static struct move_list *build_move_list(struct game *game, bool annotate) {
+	// the list API is a wrapper around generate_packed_moves
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	struct move_list *list = alloc_move(game); // dummy node to simplify adding moves to the list
+	if (!list) return NULL;
+	for (size_t i = count; i > 0; --i) { // add_move inserts at the start
+		struct move move = unpack_move(moves[i - 1]);
+		if (annotate) {
+			move_to_san(game, moves[i - 1], move.notation);
+			// annotate check/stalemate/checkmate for the other player
+			if (make_move(game, moves[i - 1])) {
+				move.state = get_move_state(game, game->active_color);
+				unmake_move(game);
+			}
+		}
+		if (!add_move(game, list, move)) {
+			free_move_list(game, list);
+			return NULL;
+		}
+	}
 	struct move_list *new_list = list->next;
 	game->free(list); // free the dummy node
 	return new_list;
 }
 
+struct move_list *get_legal_moves(struct game *game) {
+	return build_move_list(game, true);
+}
+
+struct move_list *get_legal_moves_fast(struct game *game) {
+	return build_move_list(game, false);
+}
+
 void free_move_list(struct game *game, struct move_list *list) {
 	while (list) {
 		struct move_list *next = list->next;
@@ -683,106 +829,292 @@ void free_move_list(struct game *game, struct move_list *list) {
 	}
 }
 
-static bool perform_move_internal(struct game *game, struct move move) {
-	if (!move.legal) return false;
+bool make_move(struct game *game, uint16_t move) {
+	if (game->undo_count >= CHESS_UNDO_MAX) return false;
+	struct undo *undo = &game->undo_stack[game->undo_count];
+	uint8_t from = PACKED_FROM(move), to = PACKED_TO(move), flags = PACKED_FLAGS(move);
+	enum piece_color player = game->active_color;
+	enum piece_color opponent = get_opposite_color(player);
+	undo->move = move;
+	undo->captured = TYPE_NONE;
+	undo->castle_availability[COLOR_WHITE] = game->castle_availability[COLOR_WHITE];
+	undo->castle_availability[COLOR_BLACK] = game->castle_availability[COLOR_BLACK];
+	undo->en_passant_target = game->en_passant_target;
+	undo->half_move = game->half_move;
+	undo->key = game->key;
+	// the pieces update the key as they move, the rest of the position is hashed again at the end
+	game->key ^= castle_key(game) ^ en_passant_key(game);
+
 	bool reset_half_move = false;
-	struct position king = POS(CHESS_BOARD_WIDTH - 4, game->active_color == COLOR_WHITE ? 0 : CHESS_BOARD_HEIGHT - 1);
-	struct position rook_king_side = POS(CHESS_BOARD_WIDTH - 1, king.y);
-	struct position rook_queen_side = POS(0, king.y);
-	if (move.type == MOVE_CASTLE) {
-		int8_t direction = move.castle == KING_SIDE ? 1 : -1;
-		struct position rook = move.castle == KING_SIDE ? rook_king_side : rook_queen_side;
-		struct position king = POS(CHESS_BOARD_WIDTH - 4, rook.y);
-		struct position new_rook = POS(king.x + direction, rook.y);
-		struct position new_king = POS(king.x + direction * 2, rook.y);
-		struct piece *rook_piece = get_piece(game, rook);
-		struct piece *king_piece = get_piece(game, king);
-		struct piece *new_rook_piece = get_piece(game, new_rook);
-		struct piece *new_king_piece = get_piece(game, new_king);
-		if (!rook_piece || !king_piece || !new_rook_piece || !new_king_piece) return false;
+	uint8_t king = SQUARE(CHESS_BOARD_WIDTH - 4, player == COLOR_WHITE ? 0 : CHESS_BOARD_HEIGHT - 1);
+	uint8_t rook_king_side = SQUARE(CHESS_BOARD_WIDTH - 1, SQUARE_Y(king));
+	uint8_t rook_queen_side = SQUARE(0, SQUARE_Y(king));
+	game->en_passant_target.x = 0;
+	game->en_passant_target.y = 0;
+	if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) {
+		uint8_t rook = flags == MOVE_FLAG_CASTLE_KING ? rook_king_side : rook_queen_side;
+		uint8_t new_rook = (from + to) / 2; // the square the king crosses
+		struct piece rook_piece = game->board[SQUARE_Y(rook)][SQUARE_X(rook)];
+		struct piece king_piece = game->board[SQUARE_Y(from)][SQUARE_X(from)];
 
 		// move the king
-		*new_rook_piece = *rook_piece;
-		*new_king_piece = *king_piece;
-		rook_piece->type = TYPE_NONE;
-		king_piece->type = TYPE_NONE;
+		remove_piece(game, rook);
+		remove_piece(game, from);
+		place_piece(game, new_rook, rook_piece);
+		place_piece(game, to, king_piece);
 
 		// disallow castling
-		game->castle_availability[game->active_color] = 0;
+		game->castle_availability[player] = 0;
 	} else {
-		struct piece *from_piece = get_piece(game, move.from);
-		struct piece *to_piece = get_piece(game, move.to);
-		if (!from_piece || !to_piece) return false;
+		struct piece piece = game->board[SQUARE_Y(from)][SQUARE_X(from)];
+		undo->captured = game->board[SQUARE_Y(to)][SQUARE_X(to)].type;
 
-		reset_half_move = from_piece->type == TYPE_PAWN || to_piece->type != TYPE_NONE; // if pawn moves or piece is captured
+		reset_half_move = piece.type == TYPE_PAWN || (flags & MOVE_FLAG_CAPTURE); // if pawn moves or piece is captured
 
 		// disallow castling if the king or rook moves
 		// does not matter what piece is here since the
 		// bits will already be unset if the pieces are not rooks or king
-		if (position_equal(move.from, rook_king_side)) {
-			game->castle_availability[game->active_color] &= ~GAME_CASTLE_KING_SIDE;
-		} else if (position_equal(move.from, rook_queen_side)) {
-			game->castle_availability[game->active_color] &= ~GAME_CASTLE_QUEEN_SIDE;
-		} else if (position_equal(move.from, king)) {
-			game->castle_availability[game->active_color] = 0;
+		if (from == rook_king_side) {
+			game->castle_availability[player] &= ~GAME_CASTLE_KING_SIDE;
+		} else if (from == rook_queen_side) {
+			game->castle_availability[player] &= ~GAME_CASTLE_QUEEN_SIDE;
+		} else if (from == king) {
+			game->castle_availability[player] = 0;
 		}
 
-		*to_piece = *from_piece; // move the piece
-		from_piece->type = TYPE_NONE;
+		// same for the opponent if their rook is captured before it moves
+		int8_t opponent_rank = opponent == COLOR_WHITE ? 0 : CHESS_BOARD_HEIGHT - 1;
+		if (to == SQUARE(CHESS_BOARD_WIDTH - 1, opponent_rank)) {
+			game->castle_availability[opponent] &= ~GAME_CASTLE_KING_SIDE;
+		} else if (to == SQUARE(0, opponent_rank)) {
+			game->castle_availability[opponent] &= ~GAME_CASTLE_QUEEN_SIDE;
+		}
+
+		// update the en passant target
+		if (piece.type == TYPE_PAWN && abs8(SQUARE_Y(from) - SQUARE_Y(to)) == 2)
+			game->en_passant_target = SQUARE_TO_POS((from + to) / 2);
 
 		// promote the pawn
-		if (move.type == MOVE_PROMOTION || move.type == MOVE_CAPTURE_PROMOTION) {
-			to_piece->type = move.promote_to;
-		}
+		if (flags & MOVE_FLAG_PROMOTION) piece.type = PACKED_PROMOTION(move);
 
-		// capture the pawn en passant
-		if (move.type == MOVE_CAPTURE && move.en_passant) {
-			struct piece *en_passant_piece = get_piece(game, POS(move.to.x, move.from.y));
-			if (en_passant_piece) {
-				en_passant_piece->type = TYPE_NONE;
-			}
-		}
+		// move the piece
+		remove_piece(game, from);
+		place_piece(game, to, piece);
 
-		// update the en passant target
-		if (to_piece->type == TYPE_PAWN && abs8(move.from.y - move.to.y) == 2) {
-			game->en_passant_target = POS(move.from.x, (move.from.y + move.to.y) / 2);
-		} else {
-			game->en_passant_target.x = 0;
-			game->en_passant_target.y = 0;
-		}
+		// capture the pawn en passant
+		if (flags == MOVE_FLAG_EN_PASSANT) remove_piece(game, SQUARE(SQUARE_X(to), SQUARE_Y(from)));
 	}
 
 	// update the player's turn
-	game->active_color = get_opposite_color(game->active_color);
+	game->active_color = opponent;
 
 	// increment the half move counter
 	if (reset_half_move)
 		game->half_move = 0;
-	else if (game->half_move < 50) // no need to go higher
+	else if (game->half_move < UINT16_MAX)
 		++game->half_move;
 
 	// increment the move counter
 	if (game->active_color == COLOR_WHITE) ++game->full_move;
 
+	game->key ^= castle_key(game) ^ en_passant_key(game) ^ zobrist_black;
+#ifdef CHESS_HASH_CHECK
+	assert(game->key == compute_key(game));
+#endif
+
+	++game->undo_count;
+	game->attacked_valid = 0;
 	return true;
 }
 
+void unmake_move(struct game *game) {
+	if (!game->undo_count) return;
+	struct undo *undo = &game->undo_stack[--game->undo_count];
+	uint8_t from = PACKED_FROM(undo->move), to = PACKED_TO(undo->move), flags = PACKED_FLAGS(undo->move);
+
+	// the player who made the move
+	enum piece_color player = get_opposite_color(game->active_color);
+	game->active_color = player;
+	if (player == COLOR_BLACK) --game->full_move;
+
+	if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) {
+		// put the rook back in its corner
+		uint8_t rook = SQUARE(flags == MOVE_FLAG_CASTLE_KING ? CHESS_BOARD_WIDTH - 1 : 0, SQUARE_Y(from));
+		uint8_t new_rook = (from + to) / 2;
+		struct piece rook_piece = game->board[SQUARE_Y(new_rook)][SQUARE_X(new_rook)];
+		struct piece king_piece = game->board[SQUARE_Y(to)][SQUARE_X(to)];
+		remove_piece(game, new_rook);
+		remove_piece(game, to);
+		place_piece(game, rook, rook_piece);
+		place_piece(game, from, king_piece);
+	} else {
+		struct piece piece = game->board[SQUARE_Y(to)][SQUARE_X(to)];
+		if (flags & MOVE_FLAG_PROMOTION) piece.type = TYPE_PAWN;
+		remove_piece(game, to);
+		place_piece(game, from, piece);
+
+		struct piece captured = {.type = undo->captured, .color = get_opposite_color(player)};
+		if (flags == MOVE_FLAG_EN_PASSANT) {
+			captured.type = TYPE_PAWN;
+			place_piece(game, SQUARE(SQUARE_X(to), SQUARE_Y(from)), captured);
+		} else if (captured.type != TYPE_NONE) {
+			place_piece(game, to, captured);
+		}
+	}
+
+	game->castle_availability[COLOR_WHITE] = undo->castle_availability[COLOR_WHITE];
+	game->castle_availability[COLOR_BLACK] = undo->castle_availability[COLOR_BLACK];
+	game->en_passant_target = undo->en_passant_target;
+	game->half_move = undo->half_move;
+	game->key = undo->key;
+	game->attacked_valid = 0;
+#ifdef CHESS_HASH_CHECK
+	assert(game->key == compute_key(game));
+#endif
+}
+
+void play_move_forward(struct game *game, uint16_t move) {
+	// the undo record is only needed while the move is made, so the stack never fills up
+	make_move(game, move);
+	game->undo_count = 0;
+}
+
 bool perform_move(struct game *game, struct move move) {
-	bool result = perform_move_internal(game, move);
+	if (!move.legal) return false;
+	return perform_packed_move(game, pack_move(game, move));
+}
+
+bool perform_packed_move(struct game *game, uint16_t packed) {
+	struct move move = unpack_move(packed);
+	// annotate the move for the move list
+	move_to_san(game, packed, move.notation);
+
+	// the move text has two spaces between full moves so the display can wrap it there
+	char text[48];
+	int length;
+	if (game->active_color == COLOR_WHITE)
+		length = snprintf(text, sizeof(text), "%s%zu.%s", game->move_text_length ? "  " : "", game->full_move, move.notation);
+	else if (!game->move_text_length)
+		length = snprintf(text, sizeof(text), "%zu...%s", game->full_move, move.notation);
+	else
+		length = snprintf(text, sizeof(text), " %s", move.notation);
+	size_t move_text_length = game->move_text_length;
+
+	if (game->undo_count == CHESS_UNDO_MAX) {
+		// only reachable if play continues past the seventy-five move rule, drop the oldest half of the history
+		memmove(game->undo_stack, game->undo_stack + CHESS_UNDO_MAX / 2, sizeof(struct undo) * (CHESS_UNDO_MAX / 2));
+		game->undo_count = CHESS_UNDO_MAX / 2;
+	}
+	bool result = make_move(game, packed);
 	if (!result) return false;
+	move.state = get_move_state(game, game->active_color);
 
-	// add the move to the move list
-	add_move_list_end(game, move);
+	// add the move to the move list and move text, the move is taken back if there is no memory for it
+	if (!append_move_text(game, text, length)) {
+		unmake_move(game);
+		return false;
+	}
+	if (!add_move_list_end(game, move)) {
+		game->move_text_length = move_text_length;
+		game->move_text[move_text_length] = '\0';
+		unmake_move(game);
+		return false;
+	}
+	// positions before a capture or pawn move can never repeat, so their undo records are not kept
+	if (game->half_move == 0) game->undo_count = 0;
 
 	if (move.state.stalemate) {
 		if (move.state.check)
 			game->win = game->active_color == COLOR_WHITE ? STATE_CHECKMATE_BLACK_WIN : STATE_CHECKMATE_WHITE_WIN;
 		else
 			game->win = STATE_STALEMATE;
+	} else if (insufficient_material(game)) {
+		game->win = STATE_INSUFFICIENT_MATERIAL;
+	} else if (count_repetitions(game) >= 4) {
+		game->win = STATE_FIVEFOLD_REPETITION;
+	} else if (game->half_move >= 150) {
+		game->win = STATE_SEVENTY_FIVE_MOVE_RULE;
 	}
 	return true;
 }
 
+uint16_t count_repetitions(struct game *game) {
+	// only positions with the same player to move since the last irreversible move can be the same
+	uint16_t count = 0;
+	uint16_t limit = game->half_move < game->undo_count ? game->half_move : game->undo_count;
+	for (uint16_t ply = 4; ply <= limit; ply += 2)
+		if (game->undo_stack[game->undo_count - ply].key == game->key) ++count;
+	return count;
+}
+
+enum win_state get_draw_claim(struct game *game) {
+	if (game->win != STATE_NONE) return STATE_NONE;
+	if (count_repetitions(game) >= 2) return STATE_THREEFOLD_REPETITION;
+	if (game->half_move >= 100) return STATE_FIFTY_MOVE_RULE;
+	return STATE_NONE;
+}
+
+bool claim_draw(struct game *game) {
+	enum win_state claim = get_draw_claim(game);
+	if (claim == STATE_NONE) return false;
+	game->win = claim;
+	return true;
+}
+
+// positions with only kings, knights and bishops, indexed by the number of each minor piece up to 2
+// white knights + 3 * white bishops + 9 * black knights + 27 * black bishops, one row per black bishop and knight count
+static const enum material_class {
+	MATERIAL_ALIVE,   // checkmate may be possible
+	MATERIAL_DEAD,    // checkmate is impossible
+	MATERIAL_BISHOPS, // only bishops, checkmate is impossible if they are all on the same color squares
+} material_table[81] = {
+        MATERIAL_DEAD,    MATERIAL_DEAD,  MATERIAL_ALIVE, MATERIAL_DEAD,    MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_DEAD,    MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_DEAD,    MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_BISHOPS, MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+        MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE, MATERIAL_ALIVE,   MATERIAL_ALIVE, MATERIAL_ALIVE,
+};
+
+static uint8_t min2(uint8_t x) {
+	return x < 2 ? x : 2;
+}
+
+bool insufficient_material(struct game *game) {
+	uint8_t(*count)[TYPE_PAWN + 1] = game->piece_count;
+	for (uint8_t color = 0; color < 2; ++color)
+		if (count[color][TYPE_PAWN] || count[color][TYPE_ROOK] || count[color][TYPE_QUEEN]) return false;
+	uint8_t signature = min2(count[COLOR_WHITE][TYPE_KNIGHT]) + 3 * min2(count[COLOR_WHITE][TYPE_BISHOP]) +
+	                    9 * min2(count[COLOR_BLACK][TYPE_KNIGHT]) + 27 * min2(count[COLOR_BLACK][TYPE_BISHOP]);
+	switch (material_table[signature]) {
+		case MATERIAL_DEAD:
+			return true;
+		case MATERIAL_BISHOPS:;
+			uint64_t bishops = game->pieces[TYPE_BISHOP];
+			return !(bishops & BB_LIGHT_SQUARES) || !(bishops & ~BB_LIGHT_SQUARES);
+		default:
+			return false;
+	}
+}
+
+bool can_checkmate(struct game *game, enum piece_color color) {
+	// a lone king, or a king and one minor piece, is treated as unable to checkmate when the opponent runs out of time
+	uint8_t *count = game->piece_count[color];
+	if (count[TYPE_PAWN] || count[TYPE_ROOK] || count[TYPE_QUEEN]) return true;
+	return count[TYPE_KNIGHT] + count[TYPE_BISHOP] > 1;
+}
+
+void set_timeout(struct game *game, enum piece_color color) {
+	if (game->win != STATE_NONE) return;
+	if (!can_checkmate(game, get_opposite_color(color)))
+		game->win = STATE_TIMEOUT_INSUFFICIENT_MATERIAL;
+	else
+		game->win = color == COLOR_WHITE ? STATE_TIMEOUT_BLACK_WIN : STATE_TIMEOUT_WHITE_WIN;
+}
+
 enum color_opt get_winner(struct game *game) {
 	// TODO: proper logic for win conditions
 	switch (game->win) {
@@ -799,52 +1131,36 @@ enum color_opt get_winner(struct game *game) {
 	}
 }
 
-char *get_move_string(struct game *game) {
-	size_t i = 0; // count number of moves to allocate the correct amount of memory
-	for (struct move_list *list = game->move_list; list; list = list->next) {
-		++i;
-	}
-	// allocate based on the max size of a move string
-	char *move = game->malloc(
-	        i * (24 + sizeof(((struct move *) NULL)->notation)) + (8 * sizeof(char)) + 1);
-	if (!move) {
-		perror("malloc");
-		exit(1);
-	}
-	// 24 characters to be safe, move number can theoretically be longer than 2-3 characters
-	*move = '\0';
-
-	i = 0;
-	enum piece_color player = COLOR_WHITE;
-	for (struct move_list *list = game->move_list; list; list = list->next) {
-		if (player == COLOR_WHITE) {
-			if (i > 0) strcat(move, " "); // add space between full moves
-			char number[16];
-			// add move number
-			snprintf(number, 16, "%lu.", ++i);
-			strcat(move, number);
-		}
-		strcat(move, list->move.notation);
-		strcat(move, " ");
-		player = get_opposite_color(player);
+const char *get_result_string(struct game *game) {
+	if (game->win == STATE_NONE) return "*";
+	switch (get_winner(game)) {
+		case OPT_WHITE:
+			return "1-0";
+		case OPT_BLACK:
+			return "0-1";
+		default:
+			return "1/2-1/2";
 	}
-	if (game->win != STATE_NONE) {
-		// add the result of the game
-		switch (get_winner(game)) {
-			case OPT_WHITE:
-				strcat(move, "1-0");
-				break;
-			case OPT_BLACK:
-				strcat(move, "0-1");
-				break;
-			default:
-				strcat(move, "1/2-1/2");
-				break;
-		}
-	} else {
-		size_t len = strlen(move);
-		if (len > 0) move[len - 1] = '\0'; // remove the trailing space
+}
+
+const char *get_move_text(struct game *game) {
+	return game->move_text ? game->move_text : "";
+}
+
+char *get_move_string(struct game *game) {
+	// the move text is kept up to date by perform_move, so this is only a copy with the result added
+	const char *result = game->win != STATE_NONE ? get_result_string(game) : "";
+	size_t result_length = strlen(result);
+	char *move = game->malloc(game->move_text_length + result_length + 2);
+	if (!move) return NULL;
+	memcpy(move, get_move_text(game), game->move_text_length);
+	size_t length = game->move_text_length;
+	if (result_length) {
+		if (length) move[length++] = ' ';
+		memcpy(move + length, result, result_length);
+		length += result_length;
 	}
+	move[length] = '\0';
 	return move;
 }
 
@@ -925,18 +1241,93 @@ confirm:
 	return result;
 }
 
+static bool is_san_suffix(char c) {
+	return c == '+' || c == '#' || c == '!' || c == '?';
+}
+
+enum find_move_reason find_san_move(struct game *game, const char *san, size_t length, uint16_t *out_move) {
+	// strict SAN as written in PGN, so case matters and b is always a file
+	// the token is matched against the packed legal moves without writing notation for any of them
+	while (length > 0 && is_san_suffix(san[length - 1])) --length;
+	if (length < 2) return REASON_SYNTAX;
+
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	if (count == 0) return REASON_WIN;
+
+	uint8_t castle = MOVE_FLAG_QUIET;
+	if ((length == 3 && (strncmp(san, "O-O", 3) == 0 || strncmp(san, "0-0", 3) == 0)))
+		castle = MOVE_FLAG_CASTLE_KING;
+	else if ((length == 5 && (strncmp(san, "O-O-O", 5) == 0 || strncmp(san, "0-0-0", 5) == 0)))
+		castle = MOVE_FLAG_CASTLE_QUEEN;
+
+	enum piece_type type = TYPE_PAWN, promote_to = TYPE_NONE;
+	int8_t file_from = -1, rank_from = -1;
+	uint8_t to = 0;
+	if (castle == MOVE_FLAG_QUIET) {
+		const char *c = san, *end = san + length;
+		if (*c == 'K' || *c == 'Q' || *c == 'R' || *c == 'B' || *c == 'N') type = char_to_piece(*c++).type;
+
+		// promotion, with or without the equals sign
+		if (type == TYPE_PAWN && end - c >= 3 && (end[-1] == 'Q' || end[-1] == 'R' || end[-1] == 'B' || end[-1] == 'N')) {
+			promote_to = char_to_piece(end[-1]).type;
+			--end;
+			if (end[-1] == '=') --end;
+		}
+
+		// target square
+		if (end - c < 2) return REASON_SYNTAX;
+		int8_t file_to = char_to_file(end[-2]), rank_to = char_to_rank(end[-1]);
+		if (!position_valid_xy(file_to, rank_to)) return REASON_SYNTAX;
+		to = SQUARE(file_to, rank_to);
+		end -= 2;
+		if (end > c && (end[-1] == 'x' || end[-1] == ':')) --end;
+
+		// disambiguation, file then rank
+		if (end > c && *c >= 'a' && *c <= 'h') file_from = char_to_file(*c++);
+		if (end > c && *c >= '1' && *c <= '8') rank_from = char_to_rank(*c++);
+		if (c != end) return REASON_SYNTAX;
+	}
+
+	size_t found = 0;
+	for (size_t i = 0; i < count; ++i) {
+		uint16_t move = moves[i];
+		uint8_t flags = PACKED_FLAGS(move), from = PACKED_FROM(move);
+		if (castle != MOVE_FLAG_QUIET) {
+			if (flags != castle) continue;
+		} else {
+			if (PACKED_TO(move) != to) continue;
+			if (game->board[SQUARE_Y(from)][SQUARE_X(from)].type != type) continue;
+			if (file_from >= 0 && SQUARE_X(from) != file_from) continue;
+			if (rank_from >= 0 && SQUARE_Y(from) != rank_from) continue;
+			if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) continue;
+			if (flags & MOVE_FLAG_PROMOTION) {
+				if (PACKED_PROMOTION(move) != promote_to) continue;
+			} else if (promote_to != TYPE_NONE) {
+				continue;
+			}
+		}
+		if (found++ == 0) *out_move = move;
+	}
+	if (found == 0) return REASON_NONE_FOUND;
+	if (found > 1) return REASON_AMBIGUOUS;
+	return REASON_SUCCESS;
+}
+
 enum find_move_reason find_move(struct game *game, struct move *out_move, const char *input_) {
 	if (game->win != STATE_NONE) {
 		return REASON_WIN;
 	}
 
-	// get list of legal moves
-	struct move_list *list = get_legal_moves(game);
-	if (!list) {
+	// get the legal moves, perform_move adds the notation once the move is chosen
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	if (count == 0) {
 		return REASON_WIN;
 	}
 
-	struct move_list *candidates = NULL;
+	struct move found;
+	size_t found_count = 0;
 	enum find_move_reason result;
 	char *input = NULL;
 
@@ -1004,10 +1395,9 @@ enum find_move_reason find_move(struct game *game, struct move *out_move, const
 		}
 	}
 
-	candidates = alloc_move(game);
-
-	for (struct move_list *moves = list; moves; moves = moves->next) {
-		struct move *move = &moves->move;
+	for (size_t i = 0; i < count; ++i) {
+		struct move unpacked = unpack_move(moves[i]);
+		struct move *move = &unpacked;
 		if (move->type == MOVE_CASTLE) {
 			// check if the move is a castle
 			if (castle_king && move->castle == KING_SIDE)
@@ -1035,33 +1425,30 @@ enum find_move_reason find_move(struct game *game, struct move *out_move, const
 		} else if (parse.promote_type != TYPE_NONE)
 			continue;
 	add_move:
-		add_move(game, candidates, *move);
+		// only the first match is kept, more than one is ambiguous
+		if (found_count++ == 0) found = *move;
 	}
-	// candidates has a dummy node, so the first move is candidates->next
-	struct move_list *c = candidates->next;
-	if (!c) {
+	if (found_count == 0) {
 		// no moves found
 		result = REASON_NONE_FOUND;
 		goto end;
 	}
-	if (c->next) {
+	if (found_count > 1) {
 		// more than one move found
 		result = REASON_AMBIGUOUS;
 		goto end;
 	}
 	// only one move found
 	// check if the move is legal
-	if (!c->move.legal) {
+	if (!found.legal) {
 		result = REASON_ILLEGAL;
 		goto end;
 	}
-	*out_move = c->move;
+	*out_move = found;
 	result = REASON_SUCCESS;
 	goto end;
 syntax:
 	result = REASON_SYNTAX;
 end:
-	free_move_list(game, list);
-	free_move_list(game, candidates);
 	return result;
 }
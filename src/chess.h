@@ -72,45 +72,100 @@ struct move {
 	} state;
 };
 
+// compact move used by move generation and search, struct move is only built for the UI and notation
+// bits 0-5 are the from square, 6-11 the to square and 12-15 the flags, squares are y * 8 + x
+// castling is stored as the king's move
+#define PACKED_MOVE(from_, to_, flags_) ((uint16_t) ((from_) | ((to_) << 6) | ((flags_) << 12)))
+#define PACKED_FROM(move_) ((uint8_t) ((move_) & 0x3F))
+#define PACKED_TO(move_) ((uint8_t) (((move_) >> 6) & 0x3F))
+#define PACKED_FLAGS(move_) ((uint8_t) ((move_) >> 12))
+#define PACKED_PROMOTION(move_) ((enum piece_type) (TYPE_QUEEN + (PACKED_FLAGS(move_) & 3)))
+
+enum move_flag {
+	MOVE_FLAG_QUIET = 0,
+	MOVE_FLAG_CASTLE_KING = 1,
+	MOVE_FLAG_CASTLE_QUEEN = 2,
+	MOVE_FLAG_CAPTURE = 4, // set for every capture
+	MOVE_FLAG_EN_PASSANT = 5,
+	MOVE_FLAG_PROMOTION = 8, // the low two bits are the piece promoted to, counting from TYPE_QUEEN
+};
+
+// maximum number of moves that can be made with make_move before they are unmade
+#define CHESS_UNDO_MAX (1024)
+// enough room for every legal move in any position
+#define CHESS_MAX_MOVES (256)
+// longest FEN of any position, including the null terminator
+#define CHESS_FEN_MAX (128)
+
 struct game {
 	void *(*malloc)(size_t);
 	void (*free)(void *);
 
+	// the bitboards are the position used for move generation
+	// the board array is a view of the same position kept in sync with them
 	struct piece board[CHESS_BOARD_HEIGHT][CHESS_BOARD_WIDTH];
+	uint64_t pieces[TYPE_PAWN + 1]; // indexed by enum piece_type, pieces[TYPE_NONE] is unused
+	uint64_t colors[2];
+	uint64_t occupied;
+	uint8_t piece_count[2][TYPE_PAWN + 1]; // indexed by color and enum piece_type
+	// squares attacked by each color, computed on demand by get_attacked_squares
+	uint64_t attacked[2];
+	uint8_t attacked_valid; // one bit per color
+	uint64_t key;           // zobrist hash of the position, kept up to date by make_move and update_bitboards
+
 	enum piece_color active_color;
 	uint8_t castle_availability[2];
 	struct position en_passant_target;
-	uint8_t half_move;
+	uint16_t half_move; // plies since the last capture or pawn move
 	size_t full_move;
 
 	struct move_list {
 		struct move move;
 		struct move_list *next;
 	} *move_list, *move_list_tail;
+	// the move list as text, such as "1.e4 e5  2.Nf3", appended to by perform_move
+	char *move_text;
+	size_t move_text_length, move_text_capacity;
+	char start_fen[CHESS_FEN_MAX]; // position the move list starts from, empty for the standard start position
+
+	// state that make_move cannot recover from the position alone, one entry per move made
+	// perform_move keeps the entries since the last capture or pawn move, their keys are used to find repetitions
+	struct undo {
+		uint16_t move;
+		uint8_t captured; // enum piece_type, the captured piece is always the opponent's
+		uint8_t castle_availability[2];
+		uint16_t half_move;
+		struct position en_passant_target;
+		uint64_t key; // key of the position before the move
+	} undo_stack[CHESS_UNDO_MAX];
+	uint16_t undo_count;
 
 	enum win_state {
 		STATE_NONE,
 
-		// TODO: detect checkmate
+		// set by perform_move
 		STATE_CHECKMATE_WHITE_WIN,
 		STATE_CHECKMATE_BLACK_WIN,
-		// TODO: detect timeout and handle resignation
+		// set by set_timeout
 		STATE_TIMEOUT_WHITE_WIN,
 		STATE_TIMEOUT_BLACK_WIN,
+		// TODO: handle resignation
 		STATE_RESIGNATION_WHITE_WIN,
 		STATE_RESIGNATION_BLACK_WIN,
 
-		// TODO: detect stalemate
+		// set by perform_move
 		STATE_STALEMATE,
-		// TODO: detect insufficient material
 		STATE_INSUFFICIENT_MATERIAL,         // both players have insufficient material
 		STATE_TIMEOUT_INSUFFICIENT_MATERIAL, // player 1 has insufficient material and player 2 runs out of time
 
-		// TODO: handle logic for other draw conditions
-
+		// draws that must be claimed, see claim_draw
 		STATE_FIFTY_MOVE_RULE,
 		STATE_THREEFOLD_REPETITION,
 		STATE_AGREED_DRAW,
+
+		// draws that end the game automatically
+		STATE_SEVENTY_FIVE_MOVE_RULE,
+		STATE_FIVEFOLD_REPETITION,
 	} win;
 };
 
@@ -129,6 +184,11 @@ bool position_valid_xy(int8_t x, int8_t y);
 bool position_valid(struct position pos);
 struct piece *get_piece_xy(struct game *game, int8_t x, int8_t y);
 struct piece *get_piece(struct game *game, struct position pos);
+void update_bitboards(struct game *game); // call after changing the board through get_piece or any other part of the position
+uint64_t compute_key(struct game *game);  // hash of the position from scratch, equal positions have equal keys
+bool square_attacked_by(struct game *game, struct position pos, enum piece_color color);
+uint64_t get_attacked_squares(struct game *game, enum piece_color color); // bit y * 8 + x for each attacked square
+bool in_check(struct game *game); // true if the player to move is in check
 
 struct move_list *add_move(struct game *game, struct move_list *list, struct move move);
 
@@ -136,14 +196,45 @@ enum find_move_reason {
 	REASON_SUCCESS, REASON_WIN, REASON_AMBIGUOUS, REASON_ILLEGAL, REASON_SYNTAX, REASON_NONE_FOUND
 };
 
-struct move_list *get_legal_moves(struct game *game);
-enum find_move_reason find_move(struct game *game, struct move *out_move, const char *input);
+size_t generate_moves(struct game *game, struct move *buf, size_t cap); // returns the number of legal moves written to buf
+size_t generate_packed_moves(struct game *game, uint16_t *buf, size_t cap);
+// moves split in two so a search can try the captures before generating the rest
+// captures include en passant and every promotion, quiet moves are all the other moves including castling
+enum move_stage {
+	MOVES_ALL,
+	MOVES_CAPTURES,
+	MOVES_QUIETS,
+};
+size_t generate_staged_moves(struct game *game, enum move_stage stage, uint16_t *buf, size_t cap);
+bool is_legal_move(struct game *game, uint16_t move); // true if the packed move, such as one from a transposition table, is legal in the position
+uint16_t pack_move(struct game *game, struct move move);
+struct move unpack_move(uint16_t move);
+struct move_list *get_legal_moves(struct game *game);      // moves include notation and state
+struct move_list *get_legal_moves_fast(struct game *game); // moves without notation and state
+void move_to_san(struct game *game, uint16_t move, char *notation); // notation must have room for 16 characters
+void move_to_uci(uint16_t move, char *notation);                     // e.g. e2e4 or e7e8q
+enum find_move_reason find_move(struct game *game, struct move *out_move, const char *input); // lenient matching for typed input
+enum find_move_reason find_san_move(struct game *game, const char *san, size_t length, uint16_t *out_move); // strict SAN, such as from a PGN file
 void free_move_list(struct game *game, struct move_list *list);
-bool perform_move(struct game *game, struct move move);
+bool perform_move(struct game *game, struct move move); // returns false if the move is illegal or memory ran out
+bool perform_packed_move(struct game *game, uint16_t move); // same as perform_move for a move from generate_packed_moves or find_san_move
+bool make_move(struct game *game, uint16_t move); // play a legal move that can be taken back with unmake_move
+void unmake_move(struct game *game);
+void play_move_forward(struct game *game, uint16_t move); // play a legal move that is never taken back, without keeping the history used to find repetitions
+uint16_t count_repetitions(struct game *game);   // number of earlier occurrences of the position since the last irreversible move
+enum win_state get_draw_claim(struct game *game); // STATE_THREEFOLD_REPETITION or STATE_FIFTY_MOVE_RULE if the player to move can claim a draw, otherwise STATE_NONE
+bool claim_draw(struct game *game);               // ends the game if a draw can be claimed
+bool insufficient_material(struct game *game);    // true if neither player can checkmate
+bool can_checkmate(struct game *game, enum piece_color color); // false if the player has only a king, or a king and one knight or bishop
+void set_timeout(struct game *game, enum piece_color color);   // ends the game when the player runs out of time
 
 enum color_opt get_winner(struct game *game);
-struct game *create_board(void *(*malloc_)(size_t), void (*free_)(void *));
+struct game *create_board(void *(*malloc_)(size_t), void (*free_)(void *)); // returns NULL if memory ran out
+struct game *copy_board(struct game *game);                                  // copy of the position without the move list
 void destroy_board(struct game *game);
 void board_init(struct game *game);
-char *get_move_string(struct game *game);
+char *get_move_string(struct game *game);           // move text and result in a new string, returns NULL if memory ran out
+const char *get_move_text(struct game *game);       // move text without the result, owned by the game
+const char *get_result_string(struct game *game);   // 1-0, 0-1, 1/2-1/2 or * if the game has not ended
+void clear_move_text(struct game *game);
 #endif
@@ -0,0 +1,369 @@
+#include "database.h"
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct database_builder {
+	struct game *game; // used to replay each game for its positions
+	uint8_t *records;
+	size_t records_size, records_capacity;
+	uint64_t *offsets; // start of each game's record
+	size_t game_count, game_capacity;
+	struct database_entry *entries;
+	size_t entry_count, entry_capacity;
+};
+
+static bool reserve(void **array, size_t *capacity, size_t needed, size_t size) {
+	// grow an array by doubling so adding is amortized constant time
+	if (needed <= *capacity) return true;
+	size_t new_capacity = *capacity ? *capacity : 1024;
+	while (new_capacity < needed) new_capacity *= 2;
+	void *new_array = realloc(*array, new_capacity * size);
+	if (!new_array) return false;
+	*array = new_array;
+	*capacity = new_capacity;
+	return true;
+}
+
+struct database_builder *database_builder_create(void) {
+	struct database_builder *builder = calloc(1, sizeof(struct database_builder));
+	if (!builder) return NULL;
+	builder->game = create_board(malloc, free);
+	if (!builder->game) {
+		free(builder);
+		return NULL;
+	}
+	return builder;
+}
+
+void database_builder_destroy(struct database_builder *builder) {
+	if (!builder) return;
+	destroy_board(builder->game);
+	free(builder->records);
+	free(builder->offsets);
+	free(builder->entries);
+	free(builder);
+}
+
+size_t database_builder_games(struct database_builder *builder) {
+	return builder->game_count;
+}
+
+static bool add_entry(struct database_builder *builder, uint32_t game, uint16_t ply, uint16_t move) {
+	if (!reserve((void **) &builder->entries, &builder->entry_capacity, builder->entry_count + 1, sizeof(struct database_entry)))
+		return false;
+	builder->entries[builder->entry_count++] = (struct database_entry){
+	        .key = builder->game->key,
+	        .game = game,
+	        .ply = ply,
+	        .move = move,
+	};
+	return true;
+}
+
+bool database_add_record(struct database_builder *builder, const uint8_t *record, size_t length) {
+	struct record_header header;
+	if (!record_read(record, length, &header)) return false;
+	if (builder->game_count >= DATABASE_MAX_GAMES) return false;
+	uint32_t game = (uint32_t) builder->game_count << 2 | header.result;
+
+	// replay the game for the key of every position, the entries are dropped again if the record is corrupt
+	size_t entry_count = builder->entry_count;
+	struct game *replay = builder->game;
+	struct record_header start = header;
+	start.plies = 0;
+	if (!record_replay(replay, &start, false)) return false;
+	for (uint16_t ply = 0; ply < header.plies; ++ply) {
+		uint16_t moves[CHESS_MAX_MOVES];
+		size_t count = generate_packed_moves(replay, moves, CHESS_MAX_MOVES);
+		if (header.moves[ply] >= count || !add_entry(builder, game, ply, moves[header.moves[ply]])) goto fail;
+		play_move_forward(replay, moves[header.moves[ply]]);
+	}
+	if (!add_entry(builder, game, header.plies, 0)) goto fail;
+
+	// copy the record
+	if (!reserve((void **) &builder->records, &builder->records_capacity, builder->records_size + header.size, 1)) goto fail;
+	if (!reserve((void **) &builder->offsets, &builder->game_capacity, builder->game_count + 1, sizeof(uint64_t))) goto fail;
+	memcpy(builder->records + builder->records_size, record, header.size);
+	builder->offsets[builder->game_count++] = builder->records_size;
+	builder->records_size += header.size;
+	return true;
+fail:
+	builder->entry_count = entry_count;
+	return false;
+}
+
+bool database_add_game(struct database_builder *builder, struct game *game, enum pgn_result result) {
+	size_t plies = 0;
+	for (struct move_list *list = game->move_list; list; list = list->next) ++plies;
+	if (plies > UINT16_MAX) return false;
+	uint8_t *record = malloc(RECORD_MAX_SIZE(plies));
+	if (!record) return false;
+	size_t size = record_write(game, result, record, RECORD_MAX_SIZE(plies));
+	bool added = size && database_add_record(builder, record, size);
+	free(record);
+	return added;
+}
+
+static int compare_entries(const void *a_, const void *b_) {
+	const struct database_entry *a = a_, *b = b_;
+	if (a->key != b->key) return a->key < b->key ? -1 : 1;
+	if (a->move != b->move) return a->move < b->move ? -1 : 1;
+	if (a->game != b->game) return a->game < b->game ? -1 : 1;
+	return (a->ply > b->ply) - (a->ply < b->ply);
+}
+
+static bool write_all(int fd, const void *data, size_t size) {
+	const uint8_t *c = data;
+	while (size) {
+		ssize_t written = write(fd, c, size);
+		if (written <= 0) return false;
+		c += written;
+		size -= written;
+	}
+	return true;
+}
+
+bool database_write(struct database_builder *builder, const char *path) {
+	// sorting by key puts each position's entries together and by move groups its continuations
+	qsort(builder->entries, builder->entry_count, sizeof(struct database_entry), compare_entries);
+
+	struct database_header header = {
+	        .version = DATABASE_VERSION,
+	        .game_count = builder->game_count,
+	        .entry_count = builder->entry_count,
+	        .offsets_offset = sizeof(struct database_header),
+	};
+	memcpy(header.magic, DATABASE_MAGIC, sizeof(header.magic));
+	header.records_offset = header.offsets_offset + (builder->game_count + 1) * sizeof(uint64_t);
+	// the entries are aligned so they can be read in place
+	header.entries_offset = (header.records_offset + builder->records_size + 7) & ~(uint64_t) 7;
+	uint64_t end = builder->records_size;
+	static const uint8_t padding[8];
+
+	int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) return false;
+	bool ok = write_all(fd, &header, sizeof(header)) &&
+	          write_all(fd, builder->offsets, builder->game_count * sizeof(uint64_t)) &&
+	          write_all(fd, &end, sizeof(end)) &&
+	          write_all(fd, builder->records, builder->records_size) &&
+	          write_all(fd, padding, header.entries_offset - header.records_offset - builder->records_size) &&
+	          write_all(fd, builder->entries, builder->entry_count * sizeof(struct database_entry));
+	if (close(fd) != 0) ok = false;
+	return ok;
+}
+
+bool database_open(struct database *database, const char *path) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(struct database_header)) {
+		close(fd);
+		return false;
+	}
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) return false;
+	database->data = data;
+	database->size = st.st_size;
+	database->header = data;
+
+	// check that every section is inside the file, aligned and in order, so lookups never have to
+	const struct database_header *header = database->header;
+	uint64_t size = database->size;
+	if (memcmp(header->magic, DATABASE_MAGIC, sizeof(header->magic)) != 0 || header->version != DATABASE_VERSION ||
+	    header->game_count > DATABASE_MAX_GAMES || header->entry_count > size / sizeof(struct database_entry) ||
+	    header->offsets_offset % 8 || header->entries_offset % 8 ||
+	    header->offsets_offset > size || (header->game_count + 1) * sizeof(uint64_t) > size - header->offsets_offset ||
+	    header->records_offset > size || header->entries_offset > size ||
+	    header->offsets_offset + (header->game_count + 1) * sizeof(uint64_t) > header->records_offset ||
+	    header->records_offset > header->entries_offset ||
+	    header->entry_count * sizeof(struct database_entry) > size - header->entries_offset)
+		goto fail;
+	database->offsets = (const uint64_t *) (database->data + header->offsets_offset);
+	database->entries = (const struct database_entry *) (database->data + header->entries_offset);
+	if (database->offsets[header->game_count] > header->entries_offset - header->records_offset) goto fail;
+	madvise(data, database->size, MADV_RANDOM);
+	return true;
+fail:
+	database_close(database);
+	return false;
+}
+
+void database_close(struct database *database) {
+	if (database->data) munmap((void *) database->data, database->size);
+	database->data = NULL;
+}
+
+size_t database_find(const struct database *database, uint64_t key, const struct database_entry **first) {
+	const struct database_entry *entries = database->entries;
+	size_t count = database->header->entry_count;
+	// lower bound of the key, then the end of its run
+	size_t low = 0, high = count;
+	while (low < high) {
+		size_t mid = low + (high - low) / 2;
+		if (entries[mid].key < key) low = mid + 1;
+		else high = mid;
+	}
+	size_t end = low;
+	while (end < count && entries[end].key == key) ++end;
+	*first = entries + low;
+	return end - low;
+}
+
+static int compare_continuations(const void *a_, const void *b_) {
+	const struct database_continuation *a = a_, *b = b_;
+	if (a->games != b->games) return a->games > b->games ? -1 : 1;
+	return (a->move > b->move) - (a->move < b->move);
+}
+
+size_t database_summarize(const struct database_entry *entries, size_t count, struct database_continuation *out, size_t capacity) {
+	size_t written = 0;
+	for (size_t i = 0; i < count; ++i) {
+		const struct database_entry *entry = &entries[i];
+		if (!entry->move) continue; // the game ended here
+		// entries are sorted by move then game, so each move's entries are together
+		// and a game that played the same move in a repeated position is only counted once
+		if (written && out[written - 1].move == entry->move) {
+			if (entries[i - 1].game == entry->game) continue;
+		} else {
+			if (written == capacity) break;
+			out[written++] = (struct database_continuation){.move = entry->move};
+		}
+		++out[written - 1].games;
+		++out[written - 1].results[DATABASE_ENTRY_RESULT(entry)];
+	}
+	qsort(out, written, sizeof(struct database_continuation), compare_continuations);
+	return written;
+}
+
+size_t database_continuations(const struct database *database, uint64_t key, struct database_continuation *out, size_t capacity) {
+	const struct database_entry *entries;
+	size_t count = database_find(database, key, &entries);
+	return database_summarize(entries, count, out, capacity);
+}
+
+bool database_game(const struct database *database, uint32_t game, struct record_header *header) {
+	if (game >= database->header->game_count) return false;
+	uint64_t start = database->offsets[game], end = database->offsets[game + 1];
+	uint64_t records_size = database->offsets[database->header->game_count];
+	if (start > end || end > records_size) return false;
+	return record_read(database->data + database->header->records_offset + start, end - start, header);
+}
+
+static bool add_pgn_file(struct database_builder *builder, const char *path, FILE *in, FILE *fp) {
+	struct pgn_reader *reader = malloc(sizeof(struct pgn_reader));
+	struct game *game = create_board(malloc, free);
+	bool result = reader && game;
+	if (!result) {
+		fprintf(fp, "Out of memory\n");
+		goto end;
+	}
+	pgn_reader_init(reader, in);
+	struct pgn_game info;
+	enum pgn_status status;
+	while ((status = pgn_read_game(reader, game, NULL, &info)) != PGN_END) {
+		if (status == PGN_INVALID) {
+			fprintf(fp, "%s:%zu: %s%s%s, skipped\n", path, info.error_line, info.error, info.error_token[0] ? " " : "", info.error_token);
+			continue;
+		}
+		if (!database_add_game(builder, game, info.result)) {
+			fprintf(fp, "%s:%zu: Game could not be added\n", path, info.line);
+			result = false;
+			break;
+		}
+	}
+end:
+	destroy_board(game);
+	free(reader);
+	return result;
+}
+
+static bool add_record_file(struct database_builder *builder, const char *path, FILE *in, FILE *fp) {
+	size_t length;
+	uint8_t *data = record_read_file(in, &length);
+	if (!data) {
+		if (ferror(in)) perror(path);
+		else
+			fprintf(fp, "Out of memory\n");
+		return false;
+	}
+	bool result = true;
+	struct record_header header;
+	for (size_t offset = 0; result && offset < length; offset += header.size) {
+		if (!record_read(data + offset, length - offset, &header) || !database_add_record(builder, data + offset, header.size)) {
+			fprintf(fp, "%s: Invalid record at byte %zu\n", path, offset);
+			result = false;
+		}
+	}
+	free(data);
+	return result;
+}
+
+bool run_database_build(const char *path, char *const *inputs, size_t input_count, FILE *fp) {
+	struct database_builder *builder = database_builder_create();
+	if (!builder) {
+		fprintf(fp, "Out of memory\n");
+		return false;
+	}
+	bool result = true;
+	for (size_t i = 0; i < input_count && result; ++i) {
+		FILE *in = fopen(inputs[i], "rb");
+		if (!in) {
+			perror(inputs[i]);
+			result = false;
+			break;
+		}
+		// a record starts with its flags, which are never a printable character
+		int first = getc(in);
+		if (first != EOF) ungetc(first, in);
+		if (first == 0 || first == RECORD_FLAG_FEN) result = add_record_file(builder, inputs[i], in, fp);
+		else
+			result = add_pgn_file(builder, inputs[i], in, fp);
+		fclose(in);
+	}
+	if (result && !database_write(builder, path)) {
+		perror(path);
+		result = false;
+	}
+	if (result) fprintf(fp, "Games: %zu\nPositions: %zu\n", builder->game_count, builder->entry_count);
+	database_builder_destroy(builder);
+	return result;
+}
+
+bool run_database_query(const char *path, struct game *game, FILE *fp) {
+	struct database database;
+	if (!database_open(&database, path)) {
+		fprintf(fp, "%s: Not a database or could not be read\n", path);
+		return false;
+	}
+	// one search finds both how often the position was reached and the moves played in it
+	const struct database_entry *entries;
+	size_t positions = database_find(&database, game->key, &entries);
+	struct database_continuation continuations[CHESS_MAX_MOVES];
+	size_t count = database_summarize(entries, positions, continuations, CHESS_MAX_MOVES);
+	fprintf(fp, "Times reached: %zu\n", positions);
+	if (count) fprintf(fp, "%-8s %8s %7s %7s %7s %7s\n", "Move", "Games", "White", "Draw", "Black", "Score");
+	for (size_t i = 0; i < count; ++i) {
+		struct database_continuation *c = &continuations[i];
+		char san[16];
+		move_to_san(game, c->move, san);
+		uint32_t white = c->results[PGN_RESULT_WHITE_WIN], black = c->results[PGN_RESULT_BLACK_WIN], draw = c->results[PGN_RESULT_DRAW];
+		uint32_t decided = white + black + draw;
+		fprintf(fp, "%-8s %8" PRIu32 " %7" PRIu32 " %7" PRIu32 " %7" PRIu32, san, c->games, white, draw, black);
+		// score for the player to move, games without a result are left out
+		if (decided) {
+			uint32_t wins = game->active_color == COLOR_WHITE ? white : black;
+			fprintf(fp, " %6.1f%%\n", 100.0 * (wins + draw * 0.5) / decided);
+		} else {
+			fprintf(fp, " %7s\n", "-");
+		}
+	}
+	database_close(&database);
+	return true;
+}
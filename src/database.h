@@ -0,0 +1,80 @@
+#ifndef DATABASE_H
+#define DATABASE_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chess.h"
+#include "pgn.h"
+#include "record.h"
+
+// a database file is used straight from an mmap, so nothing is parsed when it is opened
+//   struct database_header
+//   game_count + 1 offsets of the game records from records_offset, the last one is the end of the records
+//   the game records, see record.h
+//   entry_count struct database_entry sorted by key, then move
+#define DATABASE_MAGIC "CCHESSDB"
+#define DATABASE_VERSION (1)
+
+struct database_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	uint64_t game_count;
+	uint64_t entry_count;
+	uint64_t offsets_offset, records_offset, entries_offset;
+};
+
+// one for every position of every game, including the final one
+struct database_entry {
+	uint64_t key;
+	uint32_t game; // game number << 2 | enum pgn_result of the game
+	uint16_t ply;
+	uint16_t move; // packed move played in the position, 0 in the final position
+};
+
+#define DATABASE_ENTRY_GAME(entry_) ((entry_)->game >> 2)
+#define DATABASE_ENTRY_RESULT(entry_) ((enum pgn_result) ((entry_)->game & 3))
+#define DATABASE_MAX_GAMES ((uint32_t) 1 << 30)
+
+struct database_builder;
+
+struct database_builder *database_builder_create(void); // returns NULL if memory ran out
+void database_builder_destroy(struct database_builder *builder);
+// the add functions return false if the game is invalid or memory ran out
+bool database_add_game(struct database_builder *builder, struct game *game, enum pgn_result result); // adds the game's move list
+bool database_add_record(struct database_builder *builder, const uint8_t *record, size_t length);
+size_t database_builder_games(struct database_builder *builder);
+bool database_write(struct database_builder *builder, const char *path); // sorts the index and writes the file
+
+struct database {
+	const uint8_t *data;
+	size_t size;
+	const struct database_header *header;
+	const uint64_t *offsets;
+	const struct database_entry *entries;
+};
+
+// statistics of the games that played a move in a position
+struct database_continuation {
+	uint16_t move;
+	uint32_t games;
+	uint32_t results[PGN_RESULT_DRAW + 1]; // indexed by enum pgn_result
+};
+
+bool database_open(struct database *database, const char *path); // returns false if the file cannot be mapped or is not a database
+void database_close(struct database *database);
+// entries for the position with a binary search, returns how many follow *first
+size_t database_find(const struct database *database, uint64_t key, const struct database_entry **first);
+// moves played in the position with counts of each result, most played first, returns the number written to out
+size_t database_continuations(const struct database *database, uint64_t key, struct database_continuation *out, size_t capacity);
+// same as database_continuations for the entries database_find already found
+size_t database_summarize(const struct database_entry *entries, size_t count, struct database_continuation *out, size_t capacity);
+bool database_game(const struct database *database, uint32_t game, struct record_header *header); // header of a game's record
+
+// builds a database from PGN files and files of records, an invalid PGN game is reported and skipped
+bool run_database_build(const char *path, char *const *inputs, size_t input_count, FILE *fp);
+// prints the moves played in the game's position
+bool run_database_query(const char *path, struct game *game, FILE *fp);
+#endif
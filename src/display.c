@@ -1,7 +1,7 @@
 #include "display.h"
 #include <string.h>
 
-static bool print_line(struct display_settings display, char **line, FILE *fp) {
+static bool print_line(struct display_settings display, const char **line, FILE *fp) {
 	const size_t limit = 100;
 	if (!line) return false;
 	if (!*line) return false;
@@ -94,7 +94,16 @@ static void print_piece(struct display_settings display, struct piece p, FILE *f
 		print_colored(display, p.color, c, fp);
 }
 
-static void print_files(struct display_settings display, char **line, FILE *fp) {
+static void print_move_line(struct display_settings display, const char **line, const char **result, FILE *fp) {
+	// the result is shown on its own line after the moves
+	if ((!*line || !**line) && *result) {
+		*line = *result;
+		*result = NULL;
+	}
+	print_line(display, line, fp);
+}
+
+static void print_files(struct display_settings display, const char **line, const char **result, FILE *fp) {
 	fprintf(fp, "  ");
 	for (uint8_t x_ = 0; x_ < CHESS_BOARD_WIDTH; x_++) {
 		uint8_t x = display.view_flip ? CHESS_BOARD_WIDTH - 1 - x_ : x_;
@@ -102,21 +111,23 @@ static void print_files(struct display_settings display, char **line, FILE *fp)
 		if (display.extra_space) fprintf(fp, " ");
 	}
 	fprintf(fp, "  ");
-	print_line(display, line, fp);
+	print_move_line(display, line, result, fp);
 	fprintf(fp, "\n");
 }
 
 void print_moves(struct game *game, FILE *fp) {
 	char *move_str = get_move_string(game);
+	if (!move_str) return;
 	fprintf(fp, "Moves:\n%s\n", move_str);
 	game->free(move_str);
 }
 
 void print_board(struct display_settings display, struct game *game, FILE *fp) {
-	char *move_str = get_move_string(game);
-	char *whole_move_str = move_str;
+	// the move text is kept by the game, so nothing is built for each redraw
+	const char *move_str = get_move_text(game);
+	const char *result = game->win != STATE_NONE ? get_result_string(game) : NULL;
 
-	print_files(display, &move_str, fp);
+	print_files(display, &move_str, &result, fp);
 	for (uint8_t y_ = 0; y_ < CHESS_BOARD_HEIGHT; y_++) {
 		// flip if necessary
 		uint8_t y = display.view_flip ? y_ : CHESS_BOARD_HEIGHT - 1 - y_;
@@ -128,9 +139,8 @@ void print_board(struct display_settings display, struct game *game, FILE *fp) {
 			fprintf(fp, " ");
 		}
 		fprintf(fp, "%c ", rank_to_char(y));
-		print_line(display, &move_str, fp);
+		print_move_line(display, &move_str, &result, fp);
 		fprintf(fp, "\n");
 	}
-	print_files(display, &move_str, fp);
-	game->free(whole_move_str);
+	print_files(display, &move_str, &result, fp);
 }
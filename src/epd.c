@@ -0,0 +1,268 @@
+#include "epd.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "chess.h"
+#include "fen.h"
+#include "perft.h"
+#include "pool.h"
+#include "search.h"
+
+#define EPD_MAX_PERFT_DEPTH (6)
+// most moves a bm or am operation can list
+#define EPD_MAX_MOVES (8)
+
+struct epd_record {
+	const char *line;
+	size_t line_number;
+	struct game **games; // one per worker, and one more for the thread submitting the tasks
+	struct search_limits limits;
+	struct tt *tt;
+
+	enum epd_status {
+		EPD_PASS,
+		EPD_FAIL,
+		EPD_SKIPPED, // nothing in the record could be checked
+		EPD_INVALID,
+	} status;
+	char id[64];
+	char message[128];
+	uint64_t nodes;
+};
+
+struct epd_test {
+	uint64_t perft[EPD_MAX_PERFT_DEPTH + 1]; // expected counts indexed by depth, UINT64_MAX if not given
+	uint16_t best[EPD_MAX_MOVES], avoid[EPD_MAX_MOVES];
+	uint8_t best_count, avoid_count;
+};
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *skip_spaces(const char *c) {
+	while (*c == ' ' || *c == '\t' || *c == '\r') ++c;
+	return c;
+}
+
+static const char *read_operand(const char *c, char *operand, size_t size) {
+	// an operand is a word, or a string in double quotes that can contain spaces and semicolons
+	size_t length = 0;
+	if (*c == '"') {
+		for (++c; *c && *c != '"'; ++c)
+			if (length + 1 < size) operand[length++] = *c;
+		if (*c == '"') ++c;
+	} else {
+		for (; *c && *c != ' ' && *c != '\t' && *c != '\r' && *c != ';'; ++c)
+			if (length + 1 < size) operand[length++] = *c;
+	}
+	operand[length] = '\0';
+	return c;
+}
+
+static bool parse_moves(struct game *game, const char **c, uint16_t *moves, uint8_t *count, struct epd_record *record) {
+	while (**c && **c != ';') {
+		char san[16];
+		*c = skip_spaces(read_operand(*c, san, sizeof(san)));
+		if (!san[0]) continue;
+		uint16_t move;
+		if (find_san_move(game, san, strlen(san), &move) != REASON_SUCCESS) {
+			snprintf(record->message, sizeof(record->message), "illegal move %s", san);
+			return false;
+		}
+		if (*count < EPD_MAX_MOVES) moves[(*count)++] = move;
+	}
+	return true;
+}
+
+static bool parse_operations(struct game *game, const char *c, struct epd_test *test, struct epd_record *record) {
+	// operations are an opcode and its operands ended by a semicolon, such as bm Nf3 e4; or D1 20;
+	// some suites put the semicolon before each operation instead, and some end the position with FEN move counters, which are skipped
+	for (uint8_t i = 0; i <= EPD_MAX_PERFT_DEPTH; ++i) test->perft[i] = UINT64_MAX;
+	while (true) {
+		while (*c == ';' || *c == ' ' || *c == '\t' || *c == '\r') ++c;
+		if (!*c) return true;
+		char opcode[16];
+		c = skip_spaces(read_operand(c, opcode, sizeof(opcode)));
+
+		if (opcode[0] == 'D' && opcode[1] >= '1' && opcode[1] <= '0' + EPD_MAX_PERFT_DEPTH && !opcode[2]) {
+			char *end;
+			test->perft[opcode[1] - '0'] = strtoull(c, &end, 10);
+			if (end == c) {
+				snprintf(record->message, sizeof(record->message), "invalid count for %s", opcode);
+				return false;
+			}
+			c = end;
+		} else if (strcmp(opcode, "hmvc") == 0 || strcmp(opcode, "fmvn") == 0) {
+			// the move counters, which change when the fifty move rule is reached
+			char *end;
+			unsigned long long value = strtoull(c, &end, 10);
+			if (end == c) {
+				snprintf(record->message, sizeof(record->message), "invalid count for %s", opcode);
+				return false;
+			}
+			c = end;
+			if (opcode[0] == 'h') game->half_move = value < UINT16_MAX ? value : UINT16_MAX;
+			else
+				game->full_move = value ? value : 1;
+		} else if (strcmp(opcode, "bm") == 0) {
+			if (!parse_moves(game, &c, test->best, &test->best_count, record)) return false;
+		} else if (strcmp(opcode, "am") == 0) {
+			if (!parse_moves(game, &c, test->avoid, &test->avoid_count, record)) return false;
+		} else if (strcmp(opcode, "id") == 0) {
+			c = read_operand(c, record->id, sizeof(record->id));
+		}
+		// skip the operands of anything else
+		while (*c && *c != ';') {
+			char operand[64];
+			c = skip_spaces(read_operand(c, operand, sizeof(operand)));
+		}
+	}
+}
+
+static void run_record(void *data, unsigned worker) {
+	struct epd_record *record = data;
+	struct game *game = record->games[worker];
+	struct fen_error error;
+	const char *operations = game_from_epd(game, record->line, &error);
+	if (!operations) {
+		record->status = EPD_INVALID;
+		snprintf(record->message, sizeof(record->message), "invalid position at character %zu: %s", error.offset + 1, error.message);
+		return;
+	}
+	struct epd_test test = {0};
+	if (!parse_operations(game, operations, &test, record)) {
+		record->status = EPD_INVALID;
+		return;
+	}
+
+	record->status = EPD_SKIPPED;
+	for (uint8_t depth = 1; depth <= EPD_MAX_PERFT_DEPTH; ++depth) {
+		if (test.perft[depth] == UINT64_MAX) continue;
+		uint64_t nodes = perft_tt(game, depth, record->tt);
+		record->nodes += nodes;
+		if (nodes != test.perft[depth]) {
+			record->status = EPD_FAIL;
+			snprintf(record->message, sizeof(record->message), "D%u expected %llu, got %llu", depth, (unsigned long long) test.perft[depth], (unsigned long long) nodes);
+			return;
+		}
+		record->status = EPD_PASS;
+	}
+	if (!test.best_count && !test.avoid_count) return;
+
+	struct search_result result;
+	search(game, record->limits, 1, record->tt, &result, NULL);
+	record->nodes += result.nodes;
+	bool found = !test.best_count;
+	for (uint8_t i = 0; i < test.best_count; ++i) found |= result.move == test.best[i];
+	for (uint8_t i = 0; i < test.avoid_count; ++i) found &= result.move != test.avoid[i];
+	record->status = found ? EPD_PASS : EPD_FAIL;
+	if (!found) {
+		char san[16];
+		move_to_san(game, result.move, san);
+		snprintf(record->message, sizeof(record->message), "%s %s at depth %u", test.best_count ? "expected a best move, played" : "played the avoided move", san, result.depth);
+	}
+}
+
+bool run_epd(const char *path, unsigned threads, struct search_limits limits, struct tt *tt, FILE *fp) {
+	FILE *in = fopen(path, "r");
+	if (!in) {
+		perror(path);
+		return false;
+	}
+	// the whole file is read so each record can point into it
+	char *data = NULL;
+	size_t length = 0, capacity = 0;
+	bool read_error = false;
+	while (true) {
+		if (length + 1 >= capacity) {
+			capacity = capacity ? capacity * 2 : 65536;
+			char *new_data = realloc(data, capacity);
+			if (!new_data) {
+				read_error = true;
+				break;
+			}
+			data = new_data;
+		}
+		size_t read = fread(data + length, 1, capacity - length - 1, in);
+		length += read;
+		if (read == 0) break;
+	}
+	if (ferror(in)) {
+		perror(path);
+		read_error = true;
+	}
+	fclose(in);
+
+	struct epd_record *records = NULL;
+	size_t record_count = 0;
+	if (!read_error) {
+		data[length] = '\0';
+		size_t lines = 1;
+		for (size_t i = 0; i < length; ++i) lines += data[i] == '\n';
+		records = calloc(lines, sizeof(struct epd_record));
+	}
+	if (threads < 1) threads = 1;
+	struct pool *pool = pool_create(threads);
+	struct game **games = calloc(threads + 1, sizeof(struct game *));
+	bool result = false;
+	if (!records || !pool || !games) goto out_of_memory;
+	for (unsigned i = 0; i <= threads; ++i)
+		if (!(games[i] = create_board(malloc, free))) goto out_of_memory;
+
+	double start = get_time();
+	size_t line_number = 0;
+	for (char *line = data, *next; line; line = next) {
+		++line_number;
+		next = strchr(line, '\n');
+		if (next) *next++ = '\0';
+		const char *c = skip_spaces(line);
+		if (!*c || *c == '#') continue;
+		struct epd_record *record = &records[record_count++];
+		record->line = c;
+		record->line_number = line_number;
+		record->games = games;
+		record->limits = limits;
+		record->tt = tt;
+		if (!pool_submit(pool, run_record, record)) run_record(record, threads);
+	}
+	pool_wait(pool);
+	double seconds = get_time() - start;
+
+	size_t counts[EPD_INVALID + 1] = {0};
+	uint64_t nodes = 0;
+	for (size_t i = 0; i < record_count; ++i) {
+		struct epd_record *record = &records[i];
+		++counts[record->status];
+		nodes += record->nodes;
+		if (record->status == EPD_FAIL || record->status == EPD_INVALID)
+			fprintf(fp, "%s:%zu: %s%s%s\n", path, record->line_number, record->id, record->id[0] ? ": " : "", record->message);
+	}
+	size_t checked = counts[EPD_PASS] + counts[EPD_FAIL];
+	fprintf(fp, "\nRecords: %zu\n", record_count);
+	fprintf(fp, "Passed: %zu\n", counts[EPD_PASS]);
+	fprintf(fp, "Failed: %zu\n", counts[EPD_FAIL]);
+	fprintf(fp, "Invalid: %zu\n", counts[EPD_INVALID]);
+	fprintf(fp, "Skipped: %zu\n", counts[EPD_SKIPPED]);
+	if (checked) fprintf(fp, "Pass rate: %.1f%%\n", 100.0 * counts[EPD_PASS] / checked);
+	fprintf(fp, "Nodes: %llu\n", (unsigned long long) nodes);
+	fprintf(fp, "Time: %.3fs\n", seconds);
+	if (seconds > 0) fprintf(fp, "Nodes/second: %.0f\n", nodes / seconds);
+	result = !counts[EPD_FAIL] && !counts[EPD_INVALID];
+	goto end;
+
+out_of_memory:
+	if (!read_error) fprintf(fp, "Out of memory\n");
+end:
+	pool_destroy(pool);
+	if (games)
+		for (unsigned i = 0; i <= threads; ++i) destroy_board(games[i]);
+	free(games);
+	free(records);
+	free(data);
+	return result;
+}
@@ -0,0 +1,12 @@
+#ifndef EPD_H
+#define EPD_H
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "search.h"
+
+// checks every record of an EPD test suite on a thread pool and prints a summary
+// perft counts are given with the D1 to D6 opcodes, best and avoided moves with bm and am, which are searched with the limits
+// returns false if the file could not be read or any record failed
+bool run_epd(const char *path, unsigned threads, struct search_limits limits, struct tt *tt, FILE *fp); // tt may be NULL
+#endif
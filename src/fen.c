@@ -0,0 +1,288 @@
+#include "fen.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "bitboard.h"
+
+static const struct piece fen_pieces[128] = {
+        ['P'] = {TYPE_PAWN,   COLOR_WHITE},
+        ['N'] = {TYPE_KNIGHT, COLOR_WHITE},
+        ['B'] = {TYPE_BISHOP, COLOR_WHITE},
+        ['R'] = {TYPE_ROOK,   COLOR_WHITE},
+        ['Q'] = {TYPE_QUEEN,  COLOR_WHITE},
+        ['K'] = {TYPE_KING,   COLOR_WHITE},
+        ['p'] = {TYPE_PAWN,   COLOR_BLACK},
+        ['n'] = {TYPE_KNIGHT, COLOR_BLACK},
+        ['b'] = {TYPE_BISHOP, COLOR_BLACK},
+        ['r'] = {TYPE_ROOK,   COLOR_BLACK},
+        ['q'] = {TYPE_QUEEN,  COLOR_BLACK},
+        ['k'] = {TYPE_KING,   COLOR_BLACK},
+};
+
+// the fields of a position before they are copied into the game
+struct fen_position {
+	struct piece board[CHESS_BOARD_HEIGHT][CHESS_BOARD_WIDTH];
+	enum piece_color active_color;
+	uint8_t castle_availability[2];
+	struct position en_passant_target;
+	unsigned long half_move, full_move;
+};
+
+static const char *fail(struct fen_error *error, const char *start, const char *c, const char *message) {
+	if (error) {
+		error->offset = c - start;
+		error->message = message;
+	}
+	return NULL;
+}
+
+static const char *skip_spaces(const char *c) {
+	while (*c == ' ' || *c == '\t') ++c;
+	return c;
+}
+
+static const char *parse_number(const char *c, unsigned long *out) {
+	// returns NULL if there are no digits, large numbers are clamped
+	if (*c < '0' || *c > '9') return NULL;
+	unsigned long value = 0;
+	for (; *c >= '0' && *c <= '9'; ++c)
+		if (value < UINT32_MAX) value = value * 10 + (*c - '0');
+	*out = value;
+	return c;
+}
+
+static bool king_attacked(const struct fen_position *position, enum piece_color color) {
+	// the game's bitboards are not filled in until the position is loaded, so they are built here from the board
+	bitboard_init();
+	uint64_t pieces[TYPE_PAWN + 1] = {0}, colors[2] = {0};
+	for (uint8_t sq = 0; sq < 64; ++sq) {
+		struct piece piece = position->board[SQUARE_Y(sq)][SQUARE_X(sq)];
+		if (piece.type == TYPE_NONE) continue;
+		pieces[piece.type] |= BIT(sq);
+		colors[piece.color] |= BIT(sq);
+	}
+	uint64_t occupied = colors[COLOR_WHITE] | colors[COLOR_BLACK];
+	uint64_t opponent = colors[get_opposite_color(color)];
+	uint8_t king = bb_first(pieces[TYPE_KING] & colors[color]);
+	return ((pawn_attacks[color][king] & pieces[TYPE_PAWN]) |
+	        (knight_attacks[king] & pieces[TYPE_KNIGHT]) |
+	        (king_attacks[king] & pieces[TYPE_KING]) |
+	        (bishop_attacks(king, occupied) & (pieces[TYPE_BISHOP] | pieces[TYPE_QUEEN])) |
+	        (rook_attacks(king, occupied) & (pieces[TYPE_ROOK] | pieces[TYPE_QUEEN]))) &
+	       opponent;
+}
+
+static const char *parse_position(struct fen_position *position, const char *start, struct fen_error *error) {
+	// parses the four fields shared by FEN and EPD, returns a pointer to the character after them
+	memset(position->board, 0, sizeof(position->board)); // empty squares are TYPE_NONE and COLOR_WHITE
+	const char *c = skip_spaces(start);
+	uint8_t kings[2] = {0, 0};
+
+	// piece placement, starting from the eighth rank
+	int8_t x = 0, y = CHESS_BOARD_HEIGHT - 1;
+	for (; *c && *c != ' '; ++c) {
+		if (*c == '/') {
+			if (x != CHESS_BOARD_WIDTH) return fail(error, start, c, "rank does not have 8 squares");
+			if (y == 0) return fail(error, start, c, "more than 8 ranks");
+			--y;
+			x = 0;
+		} else if (*c >= '1' && *c <= '8') {
+			x += *c - '0';
+			if (x > CHESS_BOARD_WIDTH) return fail(error, start, c, "rank has more than 8 squares");
+		} else {
+			struct piece piece = (unsigned char) *c < 128 ? fen_pieces[(unsigned char) *c] : fen_pieces[0];
+			if (piece.type == TYPE_NONE) return fail(error, start, c, "invalid piece");
+			if (x >= CHESS_BOARD_WIDTH) return fail(error, start, c, "rank has more than 8 squares");
+			if (piece.type == TYPE_PAWN && (y == 0 || y == CHESS_BOARD_HEIGHT - 1))
+				return fail(error, start, c, "pawn on the first or last rank");
+			if (piece.type == TYPE_KING && kings[piece.color]++) return fail(error, start, c, "more than one king of a color");
+			position->board[y][x++] = piece;
+		}
+	}
+	if (x != CHESS_BOARD_WIDTH || y != 0) return fail(error, start, c, "board does not have 8 ranks of 8 squares");
+	if (!kings[COLOR_WHITE] || !kings[COLOR_BLACK]) return fail(error, start, c, "missing king");
+
+	// active color
+	c = skip_spaces(c);
+	if (*c == 'w')
+		position->active_color = COLOR_WHITE;
+	else if (*c == 'b')
+		position->active_color = COLOR_BLACK;
+	else
+		return fail(error, start, c, "expected w or b");
+	++c;
+	if (*c && *c != ' ' && *c != '\t') return fail(error, start, c, "expected w or b");
+
+	// castling availability
+	c = skip_spaces(c);
+	position->castle_availability[COLOR_WHITE] = 0;
+	position->castle_availability[COLOR_BLACK] = 0;
+	if (*c == '-') {
+		++c;
+	} else {
+		if (!*c || *c == ' ') return fail(error, start, c, "expected castling availability");
+		for (; *c && *c != ' ' && *c != '\t'; ++c) {
+			switch (*c) {
+				case 'K':
+					position->castle_availability[COLOR_WHITE] |= GAME_CASTLE_KING_SIDE;
+					break;
+				case 'Q':
+					position->castle_availability[COLOR_WHITE] |= GAME_CASTLE_QUEEN_SIDE;
+					break;
+				case 'k':
+					position->castle_availability[COLOR_BLACK] |= GAME_CASTLE_KING_SIDE;
+					break;
+				case 'q':
+					position->castle_availability[COLOR_BLACK] |= GAME_CASTLE_QUEEN_SIDE;
+					break;
+				default:
+					return fail(error, start, c, "invalid castling availability");
+			}
+		}
+	}
+
+	// en passant target, which must be behind a pawn that has just moved two squares
+	c = skip_spaces(c);
+	position->en_passant_target = POS(0, 0);
+	if (*c == '-') {
+		++c;
+	} else {
+		struct position target = POS(char_to_file(c[0]), char_to_rank(c[0] ? c[1] : '\0'));
+		if (!position_valid(target)) return fail(error, start, c, "invalid en passant square");
+		if (target.y != (position->active_color == COLOR_WHITE ? CHESS_BOARD_HEIGHT - 3 : 2))
+			return fail(error, start, c, "en passant square on the wrong rank");
+		// the pawn is in front of the square, and the squares it passed through are empty
+		int8_t forward = position->active_color == COLOR_WHITE ? -1 : 1;
+		struct piece pawn = position->board[target.y + forward][target.x];
+		if (pawn.type != TYPE_PAWN || pawn.color == position->active_color || position->board[target.y][target.x].type != TYPE_NONE ||
+		    position->board[target.y - forward][target.x].type != TYPE_NONE)
+			return fail(error, start, c, "en passant square is not behind a pawn that has just moved two squares");
+		position->en_passant_target = target;
+		c += 2;
+	}
+	if (*c && *c != ' ' && *c != '\t') return fail(error, start, c, "unexpected character");
+	// the player who has just moved cannot have left their king in check
+	if (king_attacked(position, get_opposite_color(position->active_color))) return fail(error, start, c, "player not to move is in check");
+	return c;
+}
+
+static void load_position(struct game *game, struct fen_position *position) {
+	// only the state a FEN describes is reset, board_init would fill in the start position first
+	free_move_list(game, game->move_list);
+	game->move_list = NULL;
+	game->move_list_tail = NULL;
+	clear_move_text(game);
+	game->undo_count = 0;
+	game->win = STATE_NONE;
+	memcpy(game->board, position->board, sizeof(game->board));
+	game->active_color = position->active_color;
+	game->castle_availability[COLOR_WHITE] = position->castle_availability[COLOR_WHITE];
+	game->castle_availability[COLOR_BLACK] = position->castle_availability[COLOR_BLACK];
+	game->en_passant_target = position->en_passant_target;
+	game->half_move = position->half_move < UINT16_MAX ? position->half_move : UINT16_MAX;
+	game->full_move = position->full_move ? position->full_move : 1;
+	update_bitboards(game);
+	// kept so the game can be written as PGN
+	game_to_fen(game, game->start_fen);
+	if (strcmp(game->start_fen, FEN_START_POSITION) == 0) game->start_fen[0] = '\0';
+}
+
+bool game_from_fen(struct game *game, const char *fen, struct fen_error *error) {
+	struct fen_position position;
+	const char *c = parse_position(&position, fen, error);
+	if (!c) return false;
+
+	// optional move counters
+	position.half_move = 0;
+	position.full_move = 1;
+	c = skip_spaces(c);
+	if (*c && *c != '\n' && *c != '\r') {
+		const char *number = c;
+		if (!(c = parse_number(number, &position.half_move))) {
+			fail(error, fen, number, "expected half move clock");
+			return false;
+		}
+		number = skip_spaces(c);
+		if (!(c = parse_number(number, &position.full_move))) {
+			fail(error, fen, number, "expected full move number");
+			return false;
+		}
+		c = skip_spaces(c);
+		if (*c && *c != '\n' && *c != '\r') {
+			fail(error, fen, c, "unexpected character after the full move number");
+			return false;
+		}
+	}
+
+	load_position(game, &position);
+	return true;
+}
+
+const char *game_from_epd(struct game *game, const char *epd, struct fen_error *error) {
+	struct fen_position position;
+	const char *c = parse_position(&position, epd, error);
+	if (!c) return NULL;
+	// EPD has no move counters, they can be given by the hmvc and fmvn operations instead
+	position.half_move = 0;
+	position.full_move = 1;
+	load_position(game, &position);
+	return skip_spaces(c);
+}
+
+static char *write_number(char *fen, size_t number) {
+	char digits[20];
+	uint8_t count = 0;
+	do {
+		digits[count++] = '0' + number % 10;
+		number /= 10;
+	} while (number);
+	while (count) *fen++ = digits[--count];
+	return fen;
+}
+
+size_t game_to_fen(struct game *game, char *fen) {
+	char *c = fen;
+	for (int8_t y = CHESS_BOARD_HEIGHT - 1; y >= 0; --y) {
+		uint8_t empty = 0;
+		for (int8_t x = 0; x < CHESS_BOARD_WIDTH; ++x) {
+			struct piece piece = game->board[y][x];
+			if (piece.type == TYPE_NONE) {
+				++empty;
+				continue;
+			}
+			if (empty) *c++ = '0' + empty;
+			empty = 0;
+			*c++ = piece_to_char_struct(piece);
+		}
+		if (empty) *c++ = '0' + empty;
+		if (y > 0) *c++ = '/';
+	}
+
+	*c++ = ' ';
+	*c++ = game->active_color == COLOR_WHITE ? 'w' : 'b';
+
+	*c++ = ' ';
+	char *castling = c;
+	if (game->castle_availability[COLOR_WHITE] & GAME_CASTLE_KING_SIDE) *c++ = 'K';
+	if (game->castle_availability[COLOR_WHITE] & GAME_CASTLE_QUEEN_SIDE) *c++ = 'Q';
+	if (game->castle_availability[COLOR_BLACK] & GAME_CASTLE_KING_SIDE) *c++ = 'k';
+	if (game->castle_availability[COLOR_BLACK] & GAME_CASTLE_QUEEN_SIDE) *c++ = 'q';
+	if (c == castling) *c++ = '-';
+
+	*c++ = ' ';
+	// (0, 0) means there is no target
+	struct position target = game->en_passant_target;
+	if (target.y == 2 || target.y == CHESS_BOARD_HEIGHT - 3) {
+		*c++ = file_to_char(target.x);
+		*c++ = rank_to_char(target.y);
+	} else {
+		*c++ = '-';
+	}
+
+	*c++ = ' ';
+	c = write_number(c, game->half_move);
+	*c++ = ' ';
+	c = write_number(c, game->full_move);
+	*c = '\0';
+	return c - fen;
+}
@@ -0,0 +1,24 @@
+#ifndef FEN_H
+#define FEN_H
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "chess.h"
+
+#define FEN_START_POSITION "rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1"
+// longest FEN game_to_fen can write, including the null terminator
+#define FEN_MAX_LENGTH CHESS_FEN_MAX
+
+struct fen_error {
+	size_t offset;       // index of the character where parsing failed
+	const char *message; // static string describing the problem
+};
+
+// the game is only changed if the whole string is valid, the move counters are optional
+// error may be NULL, nothing is allocated
+bool game_from_fen(struct game *game, const char *fen, struct fen_error *error);
+// parses the four position fields of an EPD line and returns a pointer to the operations after them, or NULL if invalid
+const char *game_from_epd(struct game *game, const char *epd, struct fen_error *error);
+// fen must have room for FEN_MAX_LENGTH characters, returns the length written
+size_t game_to_fen(struct game *game, char *fen);
+#endif
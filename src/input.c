@@ -78,7 +78,7 @@ tcsetattr:
 	return c;
 }
 
-struct move prompt_for_move(struct display_settings display, struct game *game, FILE *out, FILE *in, bool *view_flip, void (*print)(struct game *)) {
+bool prompt_for_move(struct display_settings display, struct game *game, FILE *out, FILE *in, bool *view_flip, void (*print)(struct game *), struct move *out_move) {
 	const size_t str_len = 10;
 	char str[str_len];
 	memset(str, 0, sizeof(str));
@@ -90,6 +90,7 @@ reprint_move:
 	// print move number
 	fprintf(out, "%lu.", game->full_move);
 	if (game->active_color == COLOR_BLACK) fprintf(out, "..");
+	if (get_draw_claim(game) != STATE_NONE) fprintf(out, " (enter draw to claim a draw)");
 	fprintf(out, "\n");
 	while (true) {
 		// clear line
@@ -139,7 +140,12 @@ reprint_move:
 		} else if (c == '\n' || c == '\r' || c == ' ') {
 			if (reason == REASON_SUCCESS) {
 				fprintf(out, "\n");
-				return move;
+				*out_move = move;
+				return true;
+			}
+			if (strcmp(str, "draw") == 0 && get_draw_claim(game) != STATE_NONE) {
+				fprintf(out, "\n");
+				return false;
 			}
 			if (display.color)
 				fprintf(out, "\x1b[0m");
@@ -152,6 +158,10 @@ reprint_move:
 					fprintf(out, "Illegal move");
 					break;
 				default:
+					if (strcmp(str, "draw") == 0) {
+						fprintf(out, "No draw to claim");
+						break;
+					}
 					fprintf(out, "Invalid move");
 					break;
 			}
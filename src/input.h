@@ -8,5 +8,6 @@
 
 void input_exit(FILE *fp);
 int scan_char(FILE *fp, bool blocking);
-struct move prompt_for_move(struct display_settings display, struct game *game, FILE *out, FILE *in, bool *view_flip, void (*print)(struct game *));
+// returns false instead of a move if the player claimed a draw, which can be done when get_draw_claim is not STATE_NONE
+bool prompt_for_move(struct display_settings display, struct game *game, FILE *out, FILE *in, bool *view_flip, void (*print)(struct game *), struct move *out_move);
 #endif
@@ -8,6 +8,15 @@
 #include "input.h"
 #include "chess.h"
 #include "display.h"
+#include "fen.h"
+#include "pgn.h"
+#include "perft.h"
+#include "scan.h"
+#include "database.h"
+#include "record.h"
+#include "epd.h"
+#include "search.h"
+#include "tt.h"
 
 #define eprintf(...) fprintf(stderr, __VA_ARGS__)
 
@@ -19,10 +28,13 @@ struct options {
 			PLAYER_SOCKET,
 		} type;
 		char *path;
+		struct search_limits limits; // for PLAYER_ENGINE
 	} player1, player2;
 	enum piece_color player1_color;
 	struct display_settings display;
 	char *socket;
+	char *pgn_out; // file the game is appended to as PGN when the program exits
+	int clock;     // seconds each player has for the whole game, 0 for no clock
 };
 
 char *player_type_to_str(enum player_type type) {
@@ -43,9 +55,13 @@ static struct options options = {
                     .color = true}
 };
 
+static struct player *get_player(enum piece_color color) {
+	if (options.player1_color == color) return &options.player1;
+	return &options.player2;
+}
+
 static enum player_type get_player_type(enum piece_color color) {
-	if (options.player1_color == color) return options.player1.type;
-	return options.player2.type;
+	return get_player(color)->type;
 }
 
 void print_board_opt(struct game *game) {
@@ -54,12 +70,48 @@ void print_board_opt(struct game *game) {
 
 static struct game *game = NULL;
 static bool clean_exit = false;
+static double time_left[2]; // seconds, indexed by color
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool use_time(enum piece_color color, double start) {
+	// takes the time the player spent on their move off their clock, returns false and ends the game if it ran out
+	if (!options.clock) return true;
+	time_left[color] -= get_time() - start;
+	if (time_left[color] >= 0) return true;
+	printf("%s ran out of time\n", color == COLOR_WHITE ? "White" : "Black");
+	set_timeout(game, color);
+	return false;
+}
+
+static void save_pgn(struct game *game) {
+	if (!options.pgn_out) return;
+	char date[16];
+	time_t now = time(NULL);
+	strftime(date, sizeof(date), "%Y.%m.%d", localtime(&now));
+	struct pgn_tag tags[] = {
+	        {"Date",  date                                              },
+	        {"White", player_type_to_str(get_player_type(COLOR_WHITE))},
+	        {"Black", player_type_to_str(get_player_type(COLOR_BLACK))},
+	};
+	FILE *fp = fopen(options.pgn_out, "a");
+	// a blank line separates the game from the next one appended
+	if (!fp || !pgn_write_game(game, tags, sizeof(tags) / sizeof(tags[0]), fp) || fputc('\n', fp) == EOF) eprintf("Failed to write %s\n", options.pgn_out);
+	if (fp && fclose(fp) != 0) eprintf("Failed to write %s\n", options.pgn_out);
+}
 
 void exit_func(int sig) {
 	if (sig != 0) eprintf("\nCaught signal %d\n", sig);
 	if (game) {
 		static bool printed_once = false;
-		if (!printed_once) print_moves(game, stdout);
+		if (!printed_once) {
+			print_moves(game, stdout);
+			save_pgn(game);
+		}
 		printed_once = true;
 	}
 	input_exit(stdin);
@@ -84,9 +136,13 @@ static void parse_player(char *str, struct player *player, bool *invalid) {
 	if (strcmp(str, "player") == 0 || strcmp(str, "p") == 0) {
 		player->type = PLAYER_LOCAL;
 		player->path = NULL;
+	} else if (strcmp(str, "engine") == 0 || strcmp(str, "e") == 0) {
+		player->type = PLAYER_ENGINE;
+		player->path = NULL;
+		player->limits = (struct search_limits){.time = 1000};
 	} else if (strncmp(str, "engine:", 7) == 0 || strncmp(str, "e:", 2) == 0) {
 		char *p = strchr(str, ':');
-		if (!p || p[1] == '\0') goto invalid;
+		if (!p || p[1] == '\0' || !parse_search_limits(&p[1], &player->limits)) goto invalid;
 		player->type = PLAYER_ENGINE;
 		player->path = &p[1];
 	} else if (strncmp(str, "socket:", 7) == 0 || strncmp(str, "s:", 2) == 0) {
@@ -100,6 +156,17 @@ static void parse_player(char *str, struct player *player, bool *invalid) {
 	}
 }
 
+static void parse_int(char *str, int min, int max, int *number, bool *invalid) {
+	if (*invalid) return;
+	char *end;
+	long value = str ? strtol(str, &end, 10) : -1;
+	if (!str || *end != '\0' || value < min || value > max) {
+		*invalid = true;
+		return;
+	}
+	*number = (int) value;
+}
+
 static void parse_bool(char *str, bool *value, bool *invalid) {
 	if (*invalid) return;
 	if (!str) {
@@ -118,9 +185,12 @@ int main(int argc, char *argv[]) {
 	srand(time(NULL));
 
 	bool invalid = false, player1_set = false, player2_set = false, player1_color_set = false, unicode_set = false, color_set = false, space_set = false;
+	bool divide = false, bench = false;
+	int perft_depth = -1, threads = -1, split_depth = -1, hash_size = -1;
+	char *fen = NULL, *scan_path = NULL, *build_path = NULL, *query_path = NULL, *epd_path = NULL, *limits = NULL, *convert_path = NULL, *print_path = NULL;
 
 	int opt;
-	while ((opt = getopt_long(argc, argv, ":hV1:2:c:u:C:T:s:", (struct option[]){
+	while ((opt = getopt_long(argc, argv, ":hV1:2:c:u:C:T:s:f:o:k:p:d:bt:D:P:B:Q:R:r:E:L:H:", (struct option[]){
 	                                                                   {"help",          no_argument,       0, 'h'},
 	                                                                   {"version",       no_argument,       0, 'V'},
 	                                                                   {"player1",       required_argument, 0, '1'},
@@ -130,6 +200,22 @@ int main(int argc, char *argv[]) {
 	                                                                   {"color",         required_argument, 0, 'C'},
 	                                                                   {"space",         required_argument, 0, 'T'},
 	                                                                   {"socket",        required_argument, 0, 's'},
+	                                                                   {"fen",           required_argument, 0, 'f'},
+	                                                                   {"pgn-out",       required_argument, 0, 'o'},
+	                                                                   {"clock",         required_argument, 0, 'k'},
+	                                                                   {"perft",         required_argument, 0, 'p'},
+	                                                                   {"divide",        required_argument, 0, 'd'},
+	                                                                   {"bench",         no_argument,       0, 'b'},
+	                                                                   {"threads",       required_argument, 0, 't'},
+	                                                                   {"split-depth",   required_argument, 0, 'D'},
+	                                                                   {"scan-pgn",      required_argument, 0, 'P'},
+	                                                                   {"build-db",      required_argument, 0, 'B'},
+	                                                                   {"query-db",      required_argument, 0, 'Q'},
+	                                                                   {"write-records", required_argument, 0, 'R'},
+	                                                                   {"print-records", required_argument, 0, 'r'},
+	                                                                   {"epd",           required_argument, 0, 'E'},
+	                                                                   {"limits",        required_argument, 0, 'L'},
+	                                                                   {"hash",          required_argument, 0, 'H'},
 	                                                                   {0,               0,                 0, 0  }
     },
 	                          NULL)) != -1) {
@@ -139,13 +225,30 @@ int main(int argc, char *argv[]) {
 				printf("Options:\n");
 				printf("  -h, --help\n");
 				printf("  -V, --version\n");
-				printf("  -1, --player1 (player|socket:<path>|engine:<path>)\n");
-				printf("  -2, --player2 (player|socket:<path>|engine:<path>)\n");
+				printf("  -1, --player1 (player|socket:<path>|engine[:<limits>])\n");
+				printf("  -2, --player2 (player|socket:<path>|engine[:<limits>])\n");
 				printf("  -c, --player1_color (white|black|random)\n");
 				printf("  -u, --unicode (on|yes|off|no)\n");
 				printf("  -C, --color (on|yes|off|no)\n");
 				printf("  -T, --space (on|yes|off|no)\n");
 				printf("  -S, --socket <path> - Connect to player socket (incompatible with -1, -2, -q)\n");
+				printf("  -f, --fen <fen> - Start from a position instead of the standard one\n");
+				printf("  -o, --pgn-out <path> - Append the game to a PGN file when it ends\n");
+				printf("  -k, --clock <seconds> - Time each player has for the whole game, running out loses unless the opponent cannot checkmate\n");
+				printf("  -p, --perft <depth> - Count the leaf nodes of the move tree and exit\n");
+				printf("  -d, --divide <depth> - Same as --perft, but also count each move separately\n");
+				printf("  -b, --bench - Run perft on the benchmark positions and exit\n");
+				printf("  -t, --threads <count> - Number of threads used by engines, --perft, --divide, --bench, --scan-pgn and --epd\n");
+				printf("  -D, --split-depth <depth> - Split the perft tree into tasks this many moves from the root (default 2)\n");
+				printf("  -P, --scan-pgn <path> - Play every game in a PGN file, print statistics and exit\n");
+				printf("  -B, --build-db <path> <files...> - Build a database from PGN and game record files and exit\n");
+				printf("  -Q, --query-db <path> - Print the moves played from the start position, or --fen, in a database and exit\n");
+				printf("  -R, --write-records <path> <files...> - Convert the games in PGN files to a game record file and exit\n");
+				printf("  -r, --print-records <path> - Print the games in a game record file as PGN and exit\n");
+				printf("  -E, --epd <path> - Check the perft counts and best moves in an EPD test suite, print statistics and exit\n");
+				printf("  -L, --limits <limits> - Search limits for the best moves in --epd (default depth=6)\n");
+				printf("  -H, --hash <megabytes> - Size of the transposition table used by engines, --perft, --divide and --epd, 0 for none (default %d)\n", TT_DEFAULT_SIZE);
+				printf("Limits are a list such as depth=8,nodes=100000,time=500 with the time in milliseconds, engine alone searches for 1 second\n");
 				return 0;
 			case 'V':
 				printf("Chess %s\n", PROJECT_VERSION);
@@ -199,17 +302,150 @@ int main(int argc, char *argv[]) {
 				else
 					options.socket = optarg;
 				break;
+			case 'f':
+				if (fen) invalid = true;
+				else
+					fen = optarg;
+				break;
+			case 'o':
+				if (options.pgn_out) invalid = true;
+				else
+					options.pgn_out = optarg;
+				break;
+			case 'k':
+				if (options.clock) invalid = true;
+				else
+					parse_int(optarg, 1, 86400, &options.clock, &invalid);
+				break;
+			case 'd':
+				divide = true;
+				// fall through
+			case 'p':
+				if (perft_depth >= 0) invalid = true;
+				else
+					parse_int(optarg, 0, 64, &perft_depth, &invalid);
+				break;
+			case 'b':
+				bench = true;
+				break;
+			case 't':
+				if (threads >= 0) invalid = true;
+				else
+					parse_int(optarg, 1, 1024, &threads, &invalid);
+				break;
+			case 'P':
+				if (scan_path) invalid = true;
+				else
+					scan_path = optarg;
+				break;
+			case 'B':
+				if (build_path) invalid = true;
+				else
+					build_path = optarg;
+				break;
+			case 'Q':
+				if (query_path) invalid = true;
+				else
+					query_path = optarg;
+				break;
+			case 'R':
+				if (convert_path) invalid = true;
+				else
+					convert_path = optarg;
+				break;
+			case 'r':
+				if (print_path) invalid = true;
+				else
+					print_path = optarg;
+				break;
+			case 'E':
+				if (epd_path) invalid = true;
+				else
+					epd_path = optarg;
+				break;
+			case 'L':
+				if (limits) invalid = true;
+				else
+					limits = optarg;
+				break;
+			case 'H':
+				if (hash_size >= 0) invalid = true;
+				else
+					parse_int(optarg, 0, TT_MAX_SIZE, &hash_size, &invalid);
+				break;
+			case 'D':
+				if (split_depth >= 0) invalid = true;
+				else
+					parse_int(optarg, 1, PERFT_MAX_SPLIT_DEPTH, &split_depth, &invalid);
+				break;
 			default:
 				invalid = true;
 				break;
 		}
 	}
 
-	if (optind != argc || invalid) {
+	// only --build-db and --write-records take files after the options
+	bool takes_files = build_path || convert_path;
+	if ((optind != argc && !takes_files) || (takes_files && optind == argc) || (build_path && convert_path) || invalid) {
 		eprintf("Invalid arguments\nTry --help for help\n");
 		exit(1);
 	}
 
+	struct perft_options perft_options = {
+	        .threads = threads > 0 ? threads : 1,
+	        .split_depth = split_depth > 0 ? split_depth : 2,
+	};
+
+	if (bench) return run_bench(perft_options, stdout) ? 0 : 1;
+	if (scan_path) return run_pgn_scan(scan_path, perft_options.threads, stdout) ? 0 : 1;
+	if (build_path) return run_database_build(build_path, argv + optind, argc - optind, stdout) ? 0 : 1;
+	if (convert_path) return run_record_convert(convert_path, argv + optind, argc - optind, stdout) ? 0 : 1;
+	if (print_path) return run_record_print(print_path, stdout) ? 0 : 1;
+
+	// shared by every search and perft until the program exits, only allocated if something will probe it
+	static struct tt tt;
+	struct tt *hash = NULL;
+	bool uses_hash = !query_path && (perft_depth >= 0 || epd_path || options.player1.type == PLAYER_ENGINE || options.player2.type == PLAYER_ENGINE);
+	if (hash_size < 0) hash_size = TT_DEFAULT_SIZE;
+	if (hash_size > 0 && uses_hash) {
+		if (!tt_create(&tt, hash_size)) {
+			eprintf("Out of memory\n");
+			return 1;
+		}
+		hash = &tt;
+	}
+	perft_options.tt = hash;
+
+	struct search_limits epd_limits = {.depth = 6};
+	if (limits && !parse_search_limits(limits, &epd_limits)) {
+		eprintf("Invalid search limits\nTry --help for help\n");
+		exit(1);
+	}
+	if (epd_path) return run_epd(epd_path, perft_options.threads, epd_limits, hash, stdout) ? 0 : 1;
+
+	if (perft_depth >= 0 || query_path) {
+		struct game *perft_game = create_board(malloc, free);
+		if (!perft_game) {
+			eprintf("Out of memory\n");
+			return 1;
+		}
+		struct fen_error error;
+		if (fen && !game_from_fen(perft_game, fen, &error)) {
+			eprintf("Invalid FEN at character %zu: %s\n", error.offset + 1, error.message);
+			destroy_board(perft_game);
+			return 1;
+		}
+		bool result;
+		if (query_path) {
+			result = run_database_query(query_path, perft_game, stdout);
+		} else {
+			result = run_perft(perft_game, perft_depth, divide, perft_options, stdout);
+			if (!result) eprintf("Out of memory\n");
+		}
+		destroy_board(perft_game);
+		return result ? 0 : 1;
+	}
+
 	options.display.view_flip = options.player1_color == COLOR_BLACK;
 
 	// handle signals
@@ -219,12 +455,21 @@ int main(int argc, char *argv[]) {
 	atexit(atexit_func);
 
 	game = create_board(malloc, free);
-	board_init(game);
+	if (!game) {
+		eprintf("Out of memory\n");
+		exit(1);
+	}
+	struct fen_error error;
+	if (fen && !game_from_fen(game, fen, &error)) {
+		eprintf("Invalid FEN at character %zu: %s\n", error.offset + 1, error.message);
+		exit(1);
+	}
+	time_left[COLOR_WHITE] = time_left[COLOR_BLACK] = options.clock;
 	while (true) {
 		print_board_opt(game);
 
-		struct move_list *list = get_legal_moves(game);
-		if (!list) {
+		uint16_t moves[CHESS_MAX_MOVES];
+		if (!generate_packed_moves(game, moves, CHESS_MAX_MOVES)) {
 			eprintf("No legal moves\n");
 			break;
 		}
@@ -234,10 +479,18 @@ int main(int argc, char *argv[]) {
 			break;
 		}
 
+		if (options.clock) printf("Time left: White %.1fs, Black %.1fs\n", time_left[COLOR_WHITE], time_left[COLOR_BLACK]);
+		double start = get_time();
 		switch (get_player_type(game->active_color)) {
 			case PLAYER_LOCAL:;
-				free_move_list(game, list);
-				struct move move = prompt_for_move(options.display, game, stdout, stdin, &options.display.view_flip, print_board_opt);
+				struct move move;
+				bool moved = prompt_for_move(options.display, game, stdout, stdin, &options.display.view_flip, print_board_opt, &move);
+				if (!use_time(game->active_color, start)) break;
+				if (!moved) {
+					claim_draw(game);
+					printf("Draw claimed\n");
+					break;
+				}
 				if (!perform_move(game, move)) {
 					eprintf("Failed to perform move\n");
 					exit(1);
@@ -246,14 +499,50 @@ int main(int argc, char *argv[]) {
 			case PLAYER_ENGINE:
 			case PLAYER_SOCKET:;
 				printf("%s's move\n", game->active_color == COLOR_WHITE ? "White" : "Black");
-				// TODO: implement
-				// pick first legal move
-				printf("Playing %s\n", list->move.notation);
-				if (!perform_move(game, list->move)) {
+				if (get_player_type(game->active_color) == PLAYER_SOCKET) {
+					// claim a draw as soon as possible so games between engines always end
+					if (claim_draw(game)) {
+						printf("Draw claimed\n");
+						break;
+					}
+					// TODO: implement
+					// pick first legal move, the only place its notation is needed
+					if (!use_time(game->active_color, start)) break;
+					struct move_list *list = get_legal_moves(game);
+					if (!list) {
+						eprintf("Out of memory\n");
+						exit(1);
+					}
+					printf("Playing %s\n", list->move.notation);
+					if (!perform_move(game, list->move)) {
+						eprintf("Failed to perform move\n");
+						exit(1);
+					}
+					free_move_list(game, list);
+					break;
+				}
+				struct search_limits search_limits = get_player(game->active_color)->limits;
+				if (options.clock) {
+					// spend a small share of the time left on each move
+					uint32_t share = time_left[game->active_color] * 1000 / 30 + 1;
+					if (!search_limits.time || search_limits.time > share) search_limits.time = share;
+				}
+				struct search_result result;
+				search(game, search_limits, perft_options.threads, hash, &result, NULL);
+				if (!use_time(game->active_color, start)) break;
+				// the engine only claims a draw it cannot expect to do better than
+				if (result.score <= 0 && claim_draw(game)) {
+					printf("Draw claimed\n");
+					break;
+				}
+				char notation[16], score[16];
+				move_to_san(game, result.move, notation);
+				search_score_string(result.score, score, sizeof(score));
+				printf("Playing %s (%s, depth %u, %llu nodes)\n", notation, score, result.depth, (unsigned long long) result.nodes);
+				if (!perform_packed_move(game, result.move)) {
 					eprintf("Failed to perform move\n");
 					exit(1);
 				}
-				free_move_list(game, list);
 				break;
 		}
 	}
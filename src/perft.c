@@ -0,0 +1,237 @@
+#include "perft.h"
+#include <stdlib.h>
+#include <time.h>
+
+#include "fen.h"
+#include "pool.h"
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+uint64_t perft(struct game *game, uint8_t depth) {
+	if (depth == 0) return 1;
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	// the moves are all legal, so the last ply only needs to be counted
+	if (depth == 1) return count;
+	uint64_t nodes = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (!make_move(game, moves[i])) continue;
+		nodes += perft(game, depth - 1);
+		unmake_move(game);
+	}
+	return nodes;
+}
+
+// shallower subtrees are counted faster than they are looked up
+#define PERFT_TT_MIN_DEPTH (3)
+
+uint64_t perft_tt(struct game *game, uint8_t depth, struct tt *tt) {
+	if (!tt || depth < PERFT_TT_MIN_DEPTH) return perft(game, depth);
+	uint64_t nodes = 0;
+	if (tt_probe_count(tt, game->key, depth, &nodes)) return nodes;
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	for (size_t i = 0; i < count; ++i) {
+		if (!make_move(game, moves[i])) continue;
+		if (depth > PERFT_TT_MIN_DEPTH) tt_prefetch(tt, game->key);
+		nodes += perft_tt(game, depth - 1, tt);
+		unmake_move(game);
+	}
+	tt_store_count(tt, game->key, depth, nodes);
+	return nodes;
+}
+
+// a parallel perft splits the tree into the subtrees below every sequence of split_depth moves
+// each subtree is a task, and each worker plays the moves of its tasks on its own copy of the position
+struct perft_job {
+	struct game **games; // one per worker, and one more for the thread submitting the tasks
+	struct tt *tt;
+	uint8_t depth;
+	struct perft_task {
+		struct perft_job *job;
+		uint16_t path[PERFT_MAX_SPLIT_DEPTH];
+		uint8_t length;
+		uint8_t root; // index of the first move in the root move list
+		uint64_t nodes;
+	} *tasks;
+	size_t task_count, task_capacity;
+};
+
+static bool add_tasks(struct perft_job *job, struct game *game, struct perft_task *task, uint8_t split_depth) {
+	if (task->length == split_depth) {
+		if (job->task_count == job->task_capacity) {
+			size_t capacity = job->task_capacity ? job->task_capacity * 2 : 256;
+			struct perft_task *tasks = realloc(job->tasks, capacity * sizeof(struct perft_task));
+			if (!tasks) return false;
+			job->tasks = tasks;
+			job->task_capacity = capacity;
+		}
+		job->tasks[job->task_count++] = *task;
+		return true;
+	}
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	bool result = true;
+	for (size_t i = 0; i < count && result; ++i) {
+		if (!make_move(game, moves[i])) continue;
+		if (task->length == 0) task->root = (uint8_t) i;
+		task->path[task->length++] = moves[i];
+		result = add_tasks(job, game, task, split_depth);
+		--task->length;
+		unmake_move(game);
+	}
+	return result;
+}
+
+static void run_task(void *data, unsigned worker) {
+	struct perft_task *task = data;
+	struct game *game = task->job->games[worker];
+	for (uint8_t i = 0; i < task->length; ++i) make_move(game, task->path[i]);
+	task->nodes = perft_tt(game, task->job->depth - task->length, task->job->tt);
+	for (uint8_t i = 0; i < task->length; ++i) unmake_move(game);
+}
+
+static bool perft_parallel(struct pool *pool, struct game *game, uint8_t depth, uint8_t split_depth, struct tt *tt, uint64_t *root_nodes, uint64_t *nodes) {
+	unsigned threads = pool_threads(pool);
+	struct perft_job job = {.tt = tt, .depth = depth};
+	bool result = false;
+
+	job.games = calloc(threads + 1, sizeof(struct game *));
+	if (!job.games) return false;
+	for (unsigned i = 0; i <= threads; ++i)
+		if (!(job.games[i] = copy_board(game))) goto end;
+
+	struct perft_task root_task = {.job = &job};
+	if (!add_tasks(&job, game, &root_task, split_depth)) goto end;
+
+	for (size_t i = 0; i < job.task_count; ++i) {
+		// if the task cannot be queued, run it here with the extra position
+		if (!pool_submit(pool, run_task, &job.tasks[i])) run_task(&job.tasks[i], threads);
+	}
+	pool_wait(pool);
+
+	*nodes = 0;
+	for (size_t i = 0; i < job.task_count; ++i) {
+		if (root_nodes) root_nodes[job.tasks[i].root] += job.tasks[i].nodes;
+		*nodes += job.tasks[i].nodes;
+	}
+	result = true;
+end:
+	for (unsigned i = 0; i <= threads; ++i) destroy_board(job.games[i]);
+	free(job.games);
+	free(job.tasks);
+	return result;
+}
+
+static bool count_nodes(struct pool *pool, struct game *game, uint8_t depth, uint8_t split_depth, struct tt *tt, uint64_t *root_nodes, uint64_t *nodes) {
+	// the tree is only split when there is something below the split depth
+	if (split_depth < 1) split_depth = 1;
+	if (split_depth > PERFT_MAX_SPLIT_DEPTH) split_depth = PERFT_MAX_SPLIT_DEPTH;
+	if (pool && depth > split_depth) return perft_parallel(pool, game, depth, split_depth, tt, root_nodes, nodes);
+
+	if (!root_nodes || depth == 0) {
+		*nodes = perft_tt(game, depth, tt);
+		return true;
+	}
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	*nodes = 0;
+	for (size_t i = 0; i < count; ++i) {
+		if (!make_move(game, moves[i])) continue;
+		root_nodes[i] = perft_tt(game, depth - 1, tt);
+		unmake_move(game);
+		*nodes += root_nodes[i];
+	}
+	return true;
+}
+
+static void print_speed(uint64_t nodes, double seconds, FILE *fp) {
+	fprintf(fp, "Nodes: %llu\n", (unsigned long long) nodes);
+	fprintf(fp, "Time: %.3fs\n", seconds);
+	if (seconds > 0) fprintf(fp, "Nodes/second: %.0f\n", nodes / seconds);
+}
+
+bool run_perft(struct game *game, uint8_t depth, bool divide, struct perft_options options, FILE *fp) {
+	struct pool *pool = NULL;
+	if (options.threads > 1 && !(pool = pool_create(options.threads))) return false;
+
+	double start = get_time();
+	uint64_t nodes, root_nodes[CHESS_MAX_MOVES] = {0};
+	bool result = count_nodes(pool, game, depth, options.split_depth, options.tt, divide ? root_nodes : NULL, &nodes);
+	double seconds = get_time() - start;
+	pool_destroy(pool);
+	if (!result) return false;
+
+	if (divide && depth > 0) {
+		uint16_t moves[CHESS_MAX_MOVES];
+		size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+		for (size_t i = 0; i < count; ++i) {
+			char notation[8];
+			move_to_uci(moves[i], notation);
+			fprintf(fp, "%s: %llu\n", notation, (unsigned long long) root_nodes[i]);
+		}
+		fprintf(fp, "\n");
+	}
+	print_speed(nodes, seconds, fp);
+	return true;
+}
+
+// positions and node counts from https://www.chessprogramming.org/Perft_Results
+static const struct bench_position {
+	const char *name, *fen;
+	uint8_t depth;
+	uint64_t nodes;
+} bench_positions[] = {
+        {"Start position", FEN_START_POSITION,                                                       5, 4865609},
+        {"Kiwipete",       "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",  4, 4085603},
+        {"Position 3",     "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                            6, 11030083},
+        {"Position 4",     "r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",      5, 15833292},
+        {"Position 5",     "rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",             4, 2103487},
+        {"Position 6",     "r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 4, 3894594},
+};
+
+bool run_bench(struct perft_options options, FILE *fp) {
+	struct game *game = create_board(malloc, free);
+	if (!game) return false;
+	struct pool *pool = NULL;
+	if (options.threads > 1 && !(pool = pool_create(options.threads))) {
+		destroy_board(game);
+		return false;
+	}
+
+	bool passed = true;
+	uint64_t total_nodes = 0;
+	double total_time = 0;
+	for (size_t i = 0; i < sizeof(bench_positions) / sizeof(bench_positions[0]); ++i) {
+		const struct bench_position *position = &bench_positions[i];
+		if (!game_from_fen(game, position->fen, NULL)) {
+			fprintf(fp, "%s: invalid FEN\n", position->name);
+			passed = false;
+			continue;
+		}
+		double start = get_time();
+		uint64_t nodes;
+		// the bench measures move generation, so it never uses the transposition table
+		if (!count_nodes(pool, game, position->depth, options.split_depth, NULL, NULL, &nodes)) {
+			fprintf(fp, "%s: out of memory\n", position->name);
+			passed = false;
+			continue;
+		}
+		double seconds = get_time() - start;
+		bool match = nodes == position->nodes;
+		if (!match) passed = false;
+		fprintf(fp, "%-16s depth %u: %10llu nodes %8.3fs %s\n", position->name, position->depth,
+		        (unsigned long long) nodes, seconds, match ? "ok" : "MISMATCH");
+		total_nodes += nodes;
+		total_time += seconds;
+	}
+	pool_destroy(pool);
+	destroy_board(game);
+	fprintf(fp, "\n");
+	print_speed(total_nodes, total_time, fp);
+	return passed;
+}
@@ -0,0 +1,22 @@
+#ifndef PERFT_H
+#define PERFT_H
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chess.h"
+#include "tt.h"
+
+#define PERFT_MAX_SPLIT_DEPTH (4)
+
+struct perft_options {
+	unsigned threads;    // 0 or 1 counts on the calling thread
+	uint8_t split_depth; // each subtree this many moves below the root is counted as a separate task
+	struct tt *tt;       // caches subtree counts if not NULL, never used by run_bench
+};
+
+uint64_t perft(struct game *game, uint8_t depth); // number of leaf nodes at the given depth
+uint64_t perft_tt(struct game *game, uint8_t depth, struct tt *tt); // same as perft, looking up and storing subtree counts in tt, which may be NULL
+bool run_perft(struct game *game, uint8_t depth, bool divide, struct perft_options options, FILE *fp); // prints node counts and speed, divide prints each root move, returns false if memory ran out
+bool run_bench(struct perft_options options, FILE *fp); // returns false if a node count does not match the published one
+#endif
@@ -0,0 +1,391 @@
+#include "pgn.h"
+#include <string.h>
+
+#include "fen.h"
+
+#define PGN_EOF (-1)
+
+void pgn_reader_init(struct pgn_reader *reader, FILE *fp) {
+	reader->fp = fp;
+	reader->data = reader->buffer;
+	reader->length = 0;
+	reader->position = 0;
+	reader->line = 1;
+}
+
+void pgn_reader_init_memory(struct pgn_reader *reader, const char *data, size_t length) {
+	reader->fp = NULL;
+	reader->data = data;
+	reader->length = length;
+	reader->position = 0;
+	reader->line = 1;
+}
+
+static int peek_char(struct pgn_reader *reader) {
+	if (reader->position == reader->length) {
+		// refill the buffer, memory has nothing more to read
+		if (!reader->fp) return PGN_EOF;
+		reader->length = fread(reader->buffer, 1, PGN_BUFFER_SIZE, reader->fp);
+		reader->position = 0;
+		if (reader->length == 0) return PGN_EOF;
+	}
+	return (unsigned char) reader->data[reader->position];
+}
+
+static int next_char(struct pgn_reader *reader) {
+	int c = peek_char(reader);
+	if (c == PGN_EOF) return c;
+	++reader->position;
+	if (c == '\n') ++reader->line;
+	return c;
+}
+
+static bool is_space(int c) {
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static bool is_digit(int c) {
+	return c >= '0' && c <= '9';
+}
+
+static void skip_spaces(struct pgn_reader *reader) {
+	while (true) {
+		int c = peek_char(reader);
+		if (is_space(c)) {
+			next_char(reader);
+		} else if (c == '%') {
+			// escaped line, used by some programs for their own data
+			while ((c = next_char(reader)) != PGN_EOF && c != '\n');
+		} else {
+			return;
+		}
+	}
+}
+
+static void set_error(struct pgn_game *info, struct pgn_reader *reader, const char *message, const char *token) {
+	// only the first problem in a game is reported
+	if (info->error) return;
+	info->error = message;
+	info->error_line = reader->line;
+	if (token) {
+		strncpy(info->error_token, token, sizeof(info->error_token) - 1);
+		info->error_token[sizeof(info->error_token) - 1] = '\0';
+	}
+}
+
+static bool read_tag(struct pgn_reader *reader, char *name, char *value) {
+	// [Name "value"], the value may contain \" and \\ escapes
+	next_char(reader); // [
+	while (peek_char(reader) == ' ' || peek_char(reader) == '\t') next_char(reader);
+	size_t length = 0;
+	int c;
+	while ((c = peek_char(reader)) != PGN_EOF && !is_space(c) && c != '"' && c != ']') {
+		next_char(reader);
+		if (length < PGN_TAG_NAME_MAX - 1) name[length++] = c;
+	}
+	name[length] = '\0';
+	while (peek_char(reader) == ' ' || peek_char(reader) == '\t') next_char(reader);
+
+	bool valid = length > 0 && next_char(reader) == '"';
+	length = 0;
+	while (valid && (c = next_char(reader)) != '"') {
+		if (c == '\\') c = next_char(reader);
+		if (c == PGN_EOF || c == '\n') {
+			valid = false;
+			break;
+		}
+		if (length < PGN_TAG_VALUE_MAX - 1) value[length++] = c;
+	}
+	value[length] = '\0';
+
+	// skip to the end of the tag even if it is malformed
+	while ((c = peek_char(reader)) != PGN_EOF && c != '\n' && c != ']' && c != '[') next_char(reader);
+	if (c != ']') return false;
+	next_char(reader);
+	return valid;
+}
+
+static void append_text(struct pgn_reader *reader, size_t *length, int c) {
+	if (*length < PGN_TEXT_MAX - 1) reader->text[(*length)++] = c;
+}
+
+static void read_comment(struct pgn_reader *reader, const struct pgn_callbacks *callbacks) {
+	// {comment} or ; comment to the end of the line
+	int end = next_char(reader) == '{' ? '}' : '\n';
+	size_t length = 0;
+	int c;
+	while ((c = next_char(reader)) != PGN_EOF && c != end) append_text(reader, &length, c);
+	reader->text[length] = '\0';
+	if (callbacks && callbacks->comment) callbacks->comment(callbacks->data, reader->text);
+}
+
+static void read_variation(struct pgn_reader *reader, const struct pgn_callbacks *callbacks) {
+	// variations can be nested and contain comments, which may contain parentheses
+	next_char(reader); // (
+	size_t length = 0, depth = 1;
+	int c, comment_end = 0;
+	while ((c = next_char(reader)) != PGN_EOF) {
+		if (comment_end) {
+			if (c == comment_end) comment_end = 0;
+		} else if (c == '{') {
+			comment_end = '}';
+		} else if (c == ';') {
+			comment_end = '\n';
+		} else if (c == '(') {
+			++depth;
+		} else if (c == ')' && --depth == 0) {
+			break;
+		}
+		append_text(reader, &length, c);
+	}
+	reader->text[length] = '\0';
+	if (callbacks && callbacks->variation) callbacks->variation(callbacks->data, reader->text);
+}
+
+static const char *find_move_error(enum find_move_reason reason) {
+	switch (reason) {
+		case REASON_SYNTAX:
+			return "invalid move";
+		case REASON_AMBIGUOUS:
+			return "ambiguous move";
+		case REASON_WIN:
+			return "move after the end of the game";
+		default:
+			return "illegal move";
+	}
+}
+
+enum pgn_status pgn_read_game(struct pgn_reader *reader, struct game *game, const struct pgn_callbacks *callbacks, struct pgn_game *info) {
+	memset(info, 0, sizeof(struct pgn_game));
+	skip_spaces(reader);
+	if (peek_char(reader) == PGN_EOF) return PGN_END;
+	info->line = reader->line;
+
+	// tag pairs
+	char name[PGN_TAG_NAME_MAX], value[PGN_TAG_VALUE_MAX], fen[PGN_TAG_VALUE_MAX];
+	bool has_fen = false;
+	while (peek_char(reader) == '[') {
+		if (!read_tag(reader, name, value)) {
+			set_error(info, reader, "invalid tag", NULL);
+		} else {
+			if (strcmp(name, "FEN") == 0) {
+				memcpy(fen, value, sizeof(fen));
+				has_fen = true;
+			}
+			if (callbacks && callbacks->tag) callbacks->tag(callbacks->data, name, value);
+		}
+		skip_spaces(reader);
+	}
+
+	if (!has_fen)
+		board_init(game);
+	else if (!game_from_fen(game, fen, NULL))
+		set_error(info, reader, "invalid FEN tag", NULL);
+
+	// movetext, up to the result or the tags of the next game
+	char token[32];
+	while (true) {
+		skip_spaces(reader);
+		int c = peek_char(reader);
+		if (c == PGN_EOF || c == '[') break;
+		if (c == '{' || c == ';') {
+			read_comment(reader, callbacks);
+			continue;
+		}
+		if (c == '(') {
+			read_variation(reader, callbacks);
+			continue;
+		}
+		if (c == ')' || c == '}') {
+			next_char(reader);
+			set_error(info, reader, "unbalanced parenthesis or brace", NULL);
+			continue;
+		}
+		if (c == '*') {
+			next_char(reader);
+			break;
+		}
+		if (c == '$') {
+			// numeric annotation glyph
+			next_char(reader);
+			while (is_digit(peek_char(reader))) next_char(reader);
+			continue;
+		}
+
+		size_t length = 0;
+		while ((c = peek_char(reader)) != PGN_EOF && !is_space(c) && !strchr("{}();[$*%", c)) {
+			next_char(reader);
+			if (length < sizeof(token) - 1) token[length++] = c;
+		}
+		token[length] = '\0';
+		if (length == 0) {
+			// a character that cannot start any token, such as a null byte
+			next_char(reader);
+			set_error(info, reader, "unexpected character", NULL);
+			continue;
+		}
+
+		if (strcmp(token, "1-0") == 0) {
+			info->result = PGN_RESULT_WHITE_WIN;
+			break;
+		} else if (strcmp(token, "0-1") == 0) {
+			info->result = PGN_RESULT_BLACK_WIN;
+			break;
+		} else if (strcmp(token, "1/2-1/2") == 0 || strcmp(token, "1/2") == 0) {
+			info->result = PGN_RESULT_DRAW;
+			break;
+		}
+
+		// move numbers, which may be joined to the move as in 12.e4 or 12...e4
+		const char *san = token;
+		while (is_digit(*san)) ++san;
+		if (san != token && *san != '.' && *san != '\0') san = token; // castling written with zeros
+		while (*san == '.') ++san;
+		if (*san == '\0') continue;
+
+		// the rest of an invalid game is only read to find where it ends
+		if (info->error) continue;
+		uint16_t move;
+		enum find_move_reason reason = find_san_move(game, san, strlen(san), &move);
+		if (reason != REASON_SUCCESS) {
+			set_error(info, reader, find_move_error(reason), san);
+			continue;
+		}
+		if (!perform_packed_move(game, move)) {
+			set_error(info, reader, "out of memory", san);
+			continue;
+		}
+		++info->plies;
+	}
+	return info->error ? PGN_INVALID : PGN_GAME;
+}
+
+// output is either written straight to a file or collected in a buffer allocated with the game's malloc
+struct pgn_writer {
+	struct game *game;
+	FILE *fp;
+	char *buffer;
+	size_t length, capacity;
+	size_t column;
+	bool failed;
+};
+
+static void write_text(struct pgn_writer *writer, const char *text, size_t length) {
+	if (writer->failed) return;
+	if (writer->fp) {
+		if (fwrite(text, 1, length, writer->fp) != length) writer->failed = true;
+		return;
+	}
+	if (writer->length + length + 1 > writer->capacity) {
+		size_t capacity = writer->capacity ? writer->capacity : 1024;
+		while (writer->length + length + 1 > capacity) capacity *= 2;
+		char *buffer = writer->game->malloc(capacity);
+		if (!buffer) {
+			writer->failed = true;
+			return;
+		}
+		if (writer->buffer) memcpy(buffer, writer->buffer, writer->length);
+		writer->game->free(writer->buffer);
+		writer->buffer = buffer;
+		writer->capacity = capacity;
+	}
+	memcpy(writer->buffer + writer->length, text, length);
+	writer->length += length;
+	writer->buffer[writer->length] = '\0';
+}
+
+static void write_token(struct pgn_writer *writer, const char *token, size_t length) {
+	// movetext tokens are separated by spaces, and wrapped onto a new line when the line is full
+	if (writer->column > 0) {
+		if (writer->column + 1 + length >= PGN_LINE_LENGTH) {
+			write_text(writer, "\n", 1);
+			writer->column = 0;
+		} else {
+			write_text(writer, " ", 1);
+			++writer->column;
+		}
+	}
+	write_text(writer, token, length);
+	writer->column += length;
+}
+
+static void write_tag(struct pgn_writer *writer, const char *name, const char *value) {
+	write_text(writer, "[", 1);
+	write_text(writer, name, strlen(name));
+	write_text(writer, " \"", 2);
+	for (const char *c = value; *c; ++c) {
+		// quotes and backslashes in the value are escaped
+		size_t length = strcspn(c, "\"\\");
+		write_text(writer, c, length);
+		c += length;
+		if (!*c) break;
+		write_text(writer, "\\", 1);
+		write_text(writer, c, 1);
+	}
+	write_text(writer, "\"]\n", 3);
+}
+
+static const char *find_tag(const struct pgn_tag *tags, size_t tag_count, const char *name) {
+	for (size_t i = 0; i < tag_count; ++i)
+		if (strcmp(tags[i].name, name) == 0) return tags[i].value;
+	return NULL;
+}
+
+static void write_game(struct pgn_writer *writer, struct game *game, const struct pgn_tag *tags, size_t tag_count) {
+	static const char *const roster[] = {"Event", "Site", "Date", "Round", "White", "Black"};
+	const char *result = get_result_string(game);
+	for (size_t i = 0; i < sizeof(roster) / sizeof(roster[0]); ++i) {
+		const char *value = find_tag(tags, tag_count, roster[i]);
+		write_tag(writer, roster[i], value ? value : i == 2 ? "????.??.??" : "?");
+	}
+	write_tag(writer, "Result", result);
+	if (game->start_fen[0]) {
+		write_tag(writer, "SetUp", "1");
+		write_tag(writer, "FEN", game->start_fen);
+	}
+	for (size_t i = 0; i < tag_count; ++i) {
+		bool written = strcmp(tags[i].name, "Result") == 0 || strcmp(tags[i].name, "SetUp") == 0 || strcmp(tags[i].name, "FEN") == 0;
+		for (size_t j = 0; j < sizeof(roster) / sizeof(roster[0]) && !written; ++j) written = strcmp(tags[i].name, roster[j]) == 0;
+		if (!written) write_tag(writer, tags[i].name, tags[i].value);
+	}
+	write_text(writer, "\n", 1);
+
+	// the first move's number is worked out back from the current position
+	size_t plies = 0;
+	for (struct move_list *list = game->move_list; list; list = list->next) ++plies;
+	size_t ply = (game->full_move - 1) * 2 + (game->active_color == COLOR_BLACK);
+	ply = ply >= plies ? ply - plies : 0;
+
+	char token[32];
+	for (struct move_list *list = game->move_list; list; list = list->next, ++ply) {
+		if (ply % 2 == 0 || list == game->move_list) {
+			int length = snprintf(token, sizeof(token), ply % 2 == 0 ? "%zu." : "%zu...", ply / 2 + 1);
+			write_token(writer, token, length);
+		}
+		// the move list writes castling with zeros, PGN uses the letter O
+		size_t length = strlen(list->move.notation);
+		memcpy(token, list->move.notation, length);
+		if (list->move.type == MOVE_CASTLE)
+			for (size_t i = 0; i < length; ++i)
+				if (token[i] == '0') token[i] = 'O';
+		write_token(writer, token, length);
+	}
+	write_token(writer, result, strlen(result));
+	write_text(writer, "\n", 1);
+}
+
+bool pgn_write_game(struct game *game, const struct pgn_tag *tags, size_t tag_count, FILE *fp) {
+	struct pgn_writer writer = {.game = game, .fp = fp};
+	write_game(&writer, game, tags, tag_count);
+	return !writer.failed;
+}
+
+char *pgn_game_to_string(struct game *game, const struct pgn_tag *tags, size_t tag_count) {
+	struct pgn_writer writer = {.game = game};
+	write_game(&writer, game, tags, tag_count);
+	if (writer.failed) {
+		game->free(writer.buffer);
+		return NULL;
+	}
+	return writer.buffer;
+}
@@ -0,0 +1,73 @@
+#ifndef PGN_H
+#define PGN_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "chess.h"
+
+// size of the buffer a file is read through, a game can be any length
+#define PGN_BUFFER_SIZE (65536)
+// longest comment or variation passed to a callback, longer ones are cut short
+#define PGN_TEXT_MAX (4096)
+#define PGN_TAG_NAME_MAX (64)
+#define PGN_TAG_VALUE_MAX (256)
+// movetext lines are wrapped before this many characters
+#define PGN_LINE_LENGTH (80)
+
+// reads games one at a time from a file or from memory, such as an mmap of the file
+struct pgn_reader {
+	FILE *fp;          // NULL when reading from memory
+	const char *data;  // the buffer, or the whole input when reading from memory
+	size_t length, position;
+	size_t line;       // current line, starting at 1
+	char buffer[PGN_BUFFER_SIZE];
+	char text[PGN_TEXT_MAX];
+};
+
+// optional callbacks, comments and variations are skipped when theirs is NULL
+// the strings are only valid until the callback returns
+struct pgn_callbacks {
+	void *data;
+	void (*tag)(void *data, const char *name, const char *value);
+	void (*comment)(void *data, const char *text);
+	void (*variation)(void *data, const char *text); // the variation is not played, the text does not include the parentheses
+};
+
+enum pgn_status {
+	PGN_GAME,    // a game was read and played
+	PGN_INVALID, // a game was read but could not be played, see error in struct pgn_game
+	PGN_END,     // no more games
+};
+
+struct pgn_game {
+	enum pgn_result {
+		PGN_RESULT_UNKNOWN,
+		PGN_RESULT_WHITE_WIN,
+		PGN_RESULT_BLACK_WIN,
+		PGN_RESULT_DRAW,
+	} result;
+	size_t line;  // line the game starts on
+	size_t plies; // moves played
+
+	// set for PGN_INVALID
+	const char *error;
+	size_t error_line;
+	char error_token[16]; // the move that failed, if any
+};
+
+struct pgn_tag {
+	const char *name, *value;
+};
+
+void pgn_reader_init(struct pgn_reader *reader, FILE *fp);
+void pgn_reader_init_memory(struct pgn_reader *reader, const char *data, size_t length);
+// resets the game to the start position, or the one in the FEN tag, and plays the game's moves on it with perform_packed_move
+// callbacks may be NULL, an invalid game is read to its end so the next one can still be read
+enum pgn_status pgn_read_game(struct pgn_reader *reader, struct game *game, const struct pgn_callbacks *callbacks, struct pgn_game *info);
+
+// writes the game's move list with the seven tag roster, using ? for any roster tag not given, then the other given tags
+// the Result tag always comes from the game, FEN and SetUp are added if the game did not start from the standard position
+bool pgn_write_game(struct game *game, const struct pgn_tag *tags, size_t tag_count, FILE *fp); // returns false if writing failed
+char *pgn_game_to_string(struct game *game, const struct pgn_tag *tags, size_t tag_count);       // allocated with the game's malloc, NULL if memory ran out
+#endif
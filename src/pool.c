@@ -0,0 +1,186 @@
+#include "pool.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+struct task {
+	pool_task_func run;
+	void *data;
+};
+
+struct queue {
+	pthread_mutex_t lock;
+	struct task *tasks;
+	size_t head, tail, capacity; // tasks[head] to tasks[tail - 1] are queued
+};
+
+struct worker {
+	struct pool *pool;
+	unsigned index;
+	pthread_t thread;
+};
+
+struct pool {
+	unsigned threads;
+	struct worker *workers;
+	struct queue *queues;
+
+	pthread_mutex_t lock; // protects the fields below
+	pthread_cond_t work, done;
+	unsigned next_queue; // queue for the next submitted task
+	size_t queued;  // tasks waiting in any queue
+	size_t pending; // tasks queued or running
+	bool stop;
+};
+
+static bool queue_push(struct queue *queue, struct task task) {
+	pthread_mutex_lock(&queue->lock);
+	if (queue->tail == queue->capacity) {
+		// reuse the space at the start before growing
+		size_t count = queue->tail - queue->head;
+		if (queue->head > 0 && count < queue->capacity / 2) {
+			for (size_t i = 0; i < count; ++i) queue->tasks[i] = queue->tasks[queue->head + i];
+		} else {
+			size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+			struct task *tasks = realloc(queue->tasks, capacity * sizeof(struct task));
+			if (!tasks) {
+				pthread_mutex_unlock(&queue->lock);
+				return false;
+			}
+			for (size_t i = 0; i < count; ++i) tasks[i] = tasks[queue->head + i];
+			queue->tasks = tasks;
+			queue->capacity = capacity;
+		}
+		queue->head = 0;
+		queue->tail = count;
+	}
+	queue->tasks[queue->tail++] = task;
+	pthread_mutex_unlock(&queue->lock);
+	return true;
+}
+
+static bool queue_pop(struct queue *queue, struct task *task, bool steal) {
+	// the owner takes the newest task, thieves take the oldest
+	pthread_mutex_lock(&queue->lock);
+	bool found = queue->head < queue->tail;
+	if (found) *task = steal ? queue->tasks[queue->head++] : queue->tasks[--queue->tail];
+	pthread_mutex_unlock(&queue->lock);
+	return found;
+}
+
+static bool take_task(struct pool *pool, unsigned index, struct task *task) {
+	if (queue_pop(&pool->queues[index], task, false)) return true;
+	for (unsigned i = 1; i < pool->threads; ++i)
+		if (queue_pop(&pool->queues[(index + i) % pool->threads], task, true)) return true;
+	return false;
+}
+
+static void *worker_main(void *arg) {
+	struct worker *worker = arg;
+	struct pool *pool = worker->pool;
+	while (true) {
+		struct task task;
+		if (take_task(pool, worker->index, &task)) {
+			pthread_mutex_lock(&pool->lock);
+			--pool->queued;
+			pthread_mutex_unlock(&pool->lock);
+
+			task.run(task.data, worker->index);
+
+			pthread_mutex_lock(&pool->lock);
+			if (--pool->pending == 0) pthread_cond_broadcast(&pool->done);
+			pthread_mutex_unlock(&pool->lock);
+			continue;
+		}
+
+		// sleep until there is something to take
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->queued && !pool->stop) pthread_cond_wait(&pool->work, &pool->lock);
+		bool stop = pool->stop && !pool->queued;
+		pthread_mutex_unlock(&pool->lock);
+		if (stop) break;
+	}
+	return NULL;
+}
+
+struct pool *pool_create(unsigned threads) {
+	if (threads == 0) threads = 1;
+	struct pool *pool = calloc(1, sizeof(struct pool));
+	if (!pool) return NULL;
+	pool->threads = threads;
+	pool->workers = calloc(threads, sizeof(struct worker));
+	pool->queues = calloc(threads, sizeof(struct queue));
+	if (!pool->workers || !pool->queues) goto fail;
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	for (unsigned i = 0; i < threads; ++i) pthread_mutex_init(&pool->queues[i].lock, NULL);
+
+	for (unsigned i = 0; i < threads; ++i) {
+		pool->workers[i].pool = pool;
+		pool->workers[i].index = i;
+		if (pthread_create(&pool->workers[i].thread, NULL, worker_main, &pool->workers[i]) != 0) {
+			// stop the threads that did start
+			pool->threads = i;
+			pool_destroy(pool);
+			return NULL;
+		}
+	}
+	return pool;
+fail:
+	free(pool->workers);
+	free(pool->queues);
+	free(pool);
+	return NULL;
+}
+
+unsigned pool_threads(struct pool *pool) {
+	return pool->threads;
+}
+
+bool pool_submit(struct pool *pool, pool_task_func run, void *data) {
+	// spread tasks over the queues, idle workers steal the rest
+	// the task is counted before it is pushed, since a worker can take it as soon as it is in a queue
+	pthread_mutex_lock(&pool->lock);
+	unsigned index = pool->next_queue;
+	pool->next_queue = (index + 1) % pool->threads;
+	++pool->queued;
+	++pool->pending;
+	pthread_mutex_unlock(&pool->lock);
+
+	bool pushed = queue_push(&pool->queues[index], (struct task){run, data});
+	pthread_mutex_lock(&pool->lock);
+	if (pushed) {
+		pthread_cond_signal(&pool->work);
+	} else {
+		--pool->queued;
+		if (--pool->pending == 0) pthread_cond_broadcast(&pool->done);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return pushed;
+}
+
+void pool_wait(struct pool *pool) {
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(struct pool *pool) {
+	if (!pool) return;
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+	for (unsigned i = 0; i < pool->threads; ++i) pthread_join(pool->workers[i].thread, NULL);
+
+	for (unsigned i = 0; i < pool->threads; ++i) {
+		pthread_mutex_destroy(&pool->queues[i].lock);
+		free(pool->queues[i].tasks);
+	}
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->work);
+	pthread_cond_destroy(&pool->done);
+	free(pool->workers);
+	free(pool->queues);
+	free(pool);
+}
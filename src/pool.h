@@ -0,0 +1,18 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stdbool.h>
+#include <stddef.h>
+
+// work-stealing thread pool
+// every worker has its own queue of tasks, and takes tasks from the other queues when its own is empty
+struct pool;
+
+// worker is the index of the thread running the task, less than the number of threads
+typedef void (*pool_task_func)(void *data, unsigned worker);
+
+struct pool *pool_create(unsigned threads); // returns NULL if the threads could not be started
+unsigned pool_threads(struct pool *pool);
+bool pool_submit(struct pool *pool, pool_task_func run, void *data); // returns false if memory ran out, can be called from any thread
+void pool_wait(struct pool *pool);                                    // blocks until every submitted task has finished
+void pool_destroy(struct pool *pool);                                 // waits for the remaining tasks
+#endif
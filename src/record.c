@@ -0,0 +1,237 @@
+#include "record.h"
+#include <stdlib.h>
+#include <string.h>
+
+#include "fen.h"
+
+static void write_u16(uint8_t *c, uint16_t value) {
+	c[0] = value;
+	c[1] = value >> 8;
+}
+
+static uint16_t read_u16(const uint8_t *c) {
+	return c[0] | c[1] << 8;
+}
+
+static void write_u64(uint8_t *c, uint64_t value) {
+	for (uint8_t i = 0; i < 8; ++i) c[i] = value >> (8 * i);
+}
+
+static uint64_t read_u64(const uint8_t *c) {
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < 8; ++i) value |= (uint64_t) c[i] << (8 * i);
+	return value;
+}
+
+static bool setup_position(struct game *game, const char *start_fen) {
+	if (!start_fen[0]) {
+		board_init(game);
+		return true;
+	}
+	return game_from_fen(game, start_fen, NULL);
+}
+
+size_t record_write(struct game *game, enum pgn_result result, uint8_t *buffer, size_t capacity) {
+	size_t plies = 0;
+	for (struct move_list *list = game->move_list; list; list = list->next) ++plies;
+	size_t fen_length = strlen(game->start_fen);
+	size_t size = RECORD_HEADER_SIZE + (fen_length ? 1 + fen_length : 0) + plies;
+	if (plies > UINT16_MAX || size > capacity) return 0;
+
+	// the move list only has the moves, so they are replayed on a copy to find each one's index
+	struct game *replay = copy_board(game);
+	if (!replay) return 0;
+	if (!setup_position(replay, game->start_fen)) goto fail;
+
+	buffer[0] = fen_length ? RECORD_FLAG_FEN : 0;
+	buffer[1] = result;
+	write_u16(buffer + 2, plies);
+	write_u64(buffer + 4, replay->key);
+	uint8_t *c = buffer + RECORD_HEADER_SIZE;
+	if (fen_length) {
+		*c++ = fen_length;
+		memcpy(c, game->start_fen, fen_length);
+		c += fen_length;
+	}
+
+	for (struct move_list *list = game->move_list; list; list = list->next) {
+		uint16_t moves[CHESS_MAX_MOVES];
+		size_t count = generate_packed_moves(replay, moves, CHESS_MAX_MOVES);
+		uint16_t move = pack_move(replay, list->move);
+		size_t index = 0;
+		while (index < count && moves[index] != move) ++index;
+		if (index == count) goto fail;
+		*c++ = index;
+		play_move_forward(replay, move);
+	}
+	destroy_board(replay);
+	return size;
+fail:
+	destroy_board(replay);
+	return 0;
+}
+
+bool record_read(const uint8_t *data, size_t length, struct record_header *header) {
+	if (length < RECORD_HEADER_SIZE) return false;
+	uint8_t flags = data[0];
+	if (flags & ~RECORD_FLAG_FEN || data[1] > PGN_RESULT_DRAW) return false;
+	header->result = data[1];
+	header->plies = read_u16(data + 2);
+	header->start_key = read_u64(data + 4);
+	size_t offset = RECORD_HEADER_SIZE;
+	header->start_fen[0] = '\0';
+	if (flags & RECORD_FLAG_FEN) {
+		if (offset >= length) return false;
+		size_t fen_length = data[offset++];
+		if (fen_length >= CHESS_FEN_MAX || offset + fen_length > length) return false;
+		memcpy(header->start_fen, data + offset, fen_length);
+		header->start_fen[fen_length] = '\0';
+		offset += fen_length;
+	}
+	if (offset + header->plies > length) return false;
+	header->moves = data + offset;
+	header->size = offset + header->plies;
+	return true;
+}
+
+bool record_replay(struct game *game, const struct record_header *header, bool annotate) {
+	if (!setup_position(game, header->start_fen) || game->key != header->start_key) return false;
+	for (uint16_t i = 0; i < header->plies; ++i) {
+		uint16_t moves[CHESS_MAX_MOVES];
+		size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+		if (header->moves[i] >= count) return false;
+		uint16_t move = moves[header->moves[i]];
+		if (annotate) {
+			if (!perform_packed_move(game, move)) return false;
+		} else {
+			play_move_forward(game, move);
+		}
+	}
+	return true;
+}
+
+uint8_t *record_read_file(FILE *in, size_t *length) {
+	uint8_t *data = NULL;
+	size_t capacity = 0;
+	*length = 0;
+	while (true) {
+		if (*length == capacity) {
+			capacity = capacity ? capacity * 2 : 65536;
+			uint8_t *new_data = realloc(data, capacity);
+			if (!new_data) break;
+			data = new_data;
+		}
+		size_t read = fread(data + *length, 1, capacity - *length, in);
+		*length += read;
+		if (read == 0) {
+			if (!ferror(in)) return data;
+			break;
+		}
+	}
+	free(data);
+	return NULL;
+}
+
+bool run_record_convert(const char *path, char *const *inputs, size_t input_count, FILE *fp) {
+	struct pgn_reader *reader = malloc(sizeof(struct pgn_reader));
+	struct game *game = create_board(malloc, free);
+	uint8_t *buffer = malloc(RECORD_MAX_SIZE(UINT16_MAX));
+	FILE *out = NULL;
+	size_t games = 0, bytes = 0;
+	bool result = reader && game && buffer;
+	if (!result) {
+		fprintf(fp, "Out of memory\n");
+		goto end;
+	}
+	if (!(out = fopen(path, "wb"))) {
+		perror(path);
+		result = false;
+		goto end;
+	}
+	for (size_t i = 0; i < input_count && result; ++i) {
+		FILE *in = fopen(inputs[i], "r");
+		if (!in) {
+			perror(inputs[i]);
+			result = false;
+			break;
+		}
+		pgn_reader_init(reader, in);
+		struct pgn_game info;
+		enum pgn_status status;
+		while ((status = pgn_read_game(reader, game, NULL, &info)) != PGN_END) {
+			if (status == PGN_INVALID) {
+				fprintf(fp, "%s:%zu: %s%s%s, skipped\n", inputs[i], info.error_line, info.error, info.error_token[0] ? " " : "", info.error_token);
+				continue;
+			}
+			size_t size = record_write(game, info.result, buffer, RECORD_MAX_SIZE(UINT16_MAX));
+			if (!size) {
+				fprintf(fp, "%s:%zu: Game could not be converted\n", inputs[i], info.line);
+				result = false;
+				break;
+			}
+			if (fwrite(buffer, 1, size, out) != size) {
+				perror(path);
+				result = false;
+				break;
+			}
+			++games;
+			bytes += size;
+		}
+		fclose(in);
+	}
+end:
+	if (out && fclose(out) != 0 && result) {
+		perror(path);
+		result = false;
+	}
+	if (result) fprintf(fp, "Games: %zu\nBytes: %zu\n", games, bytes);
+	free(buffer);
+	destroy_board(game);
+	free(reader);
+	return result;
+}
+
+static void set_result(struct game *game, enum pgn_result result) {
+	// a game that did not end on the board ended by resignation or agreement, so the PGN has the recorded result
+	if (game->win != STATE_NONE) return;
+	if (result == PGN_RESULT_WHITE_WIN) game->win = STATE_RESIGNATION_WHITE_WIN;
+	else if (result == PGN_RESULT_BLACK_WIN)
+		game->win = STATE_RESIGNATION_BLACK_WIN;
+	else if (result == PGN_RESULT_DRAW)
+		game->win = STATE_AGREED_DRAW;
+}
+
+bool run_record_print(const char *path, FILE *fp) {
+	FILE *in = fopen(path, "rb");
+	if (!in) {
+		perror(path);
+		return false;
+	}
+	size_t length;
+	uint8_t *data = record_read_file(in, &length);
+	if (!data) {
+		if (ferror(in)) perror(path);
+		else
+			fprintf(fp, "Out of memory\n");
+		fclose(in);
+		return false;
+	}
+	fclose(in);
+
+	struct game *game = create_board(malloc, free);
+	bool result = game;
+	if (!result) fprintf(fp, "Out of memory\n");
+	struct record_header header;
+	for (size_t offset = 0; result && offset < length; offset += header.size) {
+		if (!record_read(data + offset, length - offset, &header) || !record_replay(game, &header, true)) {
+			fprintf(fp, "%s: Invalid record at byte %zu\n", path, offset);
+			result = false;
+			break;
+		}
+		set_result(game, header.result);
+		if (!pgn_write_game(game, NULL, 0, fp) || fputc('\n', fp) == EOF) result = false;
+	}
+	destroy_board(game);
+	free(data);
+	return result;
+}
@@ -0,0 +1,48 @@
+#ifndef RECORD_H
+#define RECORD_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chess.h"
+#include "pgn.h"
+
+// binary game record, every multi-byte number is little endian
+//   byte 0     flags, RECORD_FLAG_FEN if the game does not start from the standard position
+//   byte 1     result, enum pgn_result
+//   bytes 2-3  number of plies
+//   bytes 4-11 key of the start position
+//   if RECORD_FLAG_FEN, one byte with the length of the start FEN followed by the FEN
+//   one byte per ply, the index of the move in the order generate_packed_moves returns the legal moves
+#define RECORD_FLAG_FEN (1 << 0)
+#define RECORD_HEADER_SIZE (12)
+// largest record for a game with the given number of plies
+#define RECORD_MAX_SIZE(plies_) (RECORD_HEADER_SIZE + CHESS_FEN_MAX + (plies_))
+
+struct record_header {
+	enum pgn_result result;
+	uint16_t plies;
+	uint64_t start_key;
+	char start_fen[CHESS_FEN_MAX]; // empty for the standard start position
+	const uint8_t *moves;          // points into the record
+	size_t size;                   // size of the whole record
+};
+
+// encodes the game's move list, returns the size written, or 0 if it does not fit or memory ran out
+size_t record_write(struct game *game, enum pgn_result result, uint8_t *buffer, size_t capacity);
+// reads the header of the record at the start of data, returns false if it is truncated or invalid
+bool record_read(const uint8_t *data, size_t length, struct record_header *header);
+// resets the game to the record's start position and plays its moves, returns false if the record is corrupt
+// annotate plays the moves with perform_packed_move so the game has a move list and a result
+// otherwise only the position is updated, with play_move_forward, which is much faster
+bool record_replay(struct game *game, const struct record_header *header, bool annotate);
+// reads a whole stream of records, since each record's size is only known from its header
+// returns the data allocated with malloc, or NULL if reading failed or memory ran out, check ferror to tell which
+uint8_t *record_read_file(FILE *in, size_t *length);
+
+// converts the games in PGN files to a stream of records at path, prints statistics to fp
+bool run_record_convert(const char *path, char *const *inputs, size_t input_count, FILE *fp);
+// prints the games in a stream of records as PGN to fp
+bool run_record_print(const char *path, FILE *fp);
+#endif
@@ -0,0 +1,299 @@
+#include "scan.h"
+#include <fcntl.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "pgn.h"
+#include "pool.h"
+
+// the file is split into chunks at game boundaries, each chunk is replayed as one task
+#define SCAN_MIN_CHUNK_SIZE (1 << 20)
+#define SCAN_CHUNKS_PER_THREAD (8)
+
+// termination reasons worth counting, indexed by enum win_state
+#define SCAN_STATES (STATE_FIVEFOLD_REPETITION + 1)
+
+struct scan_error {
+	size_t line;
+	const char *message;
+	char token[16];
+};
+
+struct scan_chunk {
+	const char *data;
+	size_t length;
+	size_t lines; // newlines in the chunk, used to turn chunk lines into file lines
+
+	size_t games, plies;
+	size_t results[PGN_RESULT_DRAW + 1];
+	size_t states[SCAN_STATES];
+	size_t mismatches; // games whose result tag does not match a checkmate or draw on the board
+	struct scan_error *errors;
+	size_t error_count, error_capacity;
+	bool out_of_memory;
+};
+
+// per thread allocator for the games, move list nodes are recycled instead of going back to malloc
+// every block has a header with its size so free knows which ones are nodes
+union block_header {
+	size_t size;
+	max_align_t align;
+};
+
+struct free_node {
+	struct free_node *next;
+};
+
+static _Thread_local struct free_node *free_nodes;
+
+static void *scan_malloc(size_t size) {
+	if (size == sizeof(struct move_list) && free_nodes) {
+		struct free_node *node = free_nodes;
+		free_nodes = node->next;
+		return node;
+	}
+	union block_header *header = malloc(sizeof(union block_header) + size);
+	if (!header) return NULL;
+	header->size = size;
+	return header + 1;
+}
+
+static void scan_free(void *ptr) {
+	if (!ptr) return;
+	union block_header *header = (union block_header *) ptr - 1;
+	if (header->size == sizeof(struct move_list)) {
+		struct free_node *node = ptr;
+		node->next = free_nodes;
+		free_nodes = node;
+		return;
+	}
+	free(header);
+}
+
+static void scan_release(void) {
+	// give the recycled nodes back to malloc once the thread is done with its task
+	while (free_nodes) {
+		struct free_node *node = free_nodes;
+		free_nodes = node->next;
+		free((union block_header *) node - 1);
+	}
+}
+
+static bool result_matches(enum pgn_result result, enum win_state state) {
+	// only results that follow from the position can be checked
+	switch (state) {
+		case STATE_CHECKMATE_WHITE_WIN:
+			return result == PGN_RESULT_WHITE_WIN;
+		case STATE_CHECKMATE_BLACK_WIN:
+			return result == PGN_RESULT_BLACK_WIN;
+		case STATE_STALEMATE:
+		case STATE_INSUFFICIENT_MATERIAL:
+		case STATE_SEVENTY_FIVE_MOVE_RULE:
+		case STATE_FIVEFOLD_REPETITION:
+			return result == PGN_RESULT_DRAW;
+		default:
+			return true;
+	}
+}
+
+static void add_error(struct scan_chunk *chunk, struct pgn_game *info) {
+	if (chunk->error_count == chunk->error_capacity) {
+		size_t capacity = chunk->error_capacity ? chunk->error_capacity * 2 : 16;
+		struct scan_error *errors = realloc(chunk->errors, capacity * sizeof(struct scan_error));
+		if (!errors) {
+			chunk->out_of_memory = true;
+			return;
+		}
+		chunk->errors = errors;
+		chunk->error_capacity = capacity;
+	}
+	struct scan_error *error = &chunk->errors[chunk->error_count++];
+	error->line = info->error_line;
+	error->message = info->error;
+	memcpy(error->token, info->error_token, sizeof(error->token));
+}
+
+static void scan_chunk(void *data, unsigned worker) {
+	(void) worker;
+	struct scan_chunk *chunk = data;
+	struct game *game = create_board(scan_malloc, scan_free);
+	struct pgn_reader *reader = malloc(sizeof(struct pgn_reader));
+	if (!game || !reader) {
+		// the chunk's lines are still counted, so errors in later chunks are reported on the right lines
+		chunk->out_of_memory = true;
+		const char *end = chunk->data + chunk->length;
+		for (const char *c = chunk->data; (c = memchr(c, '\n', end - c)); ++c) ++chunk->lines;
+		goto end;
+	}
+	pgn_reader_init_memory(reader, chunk->data, chunk->length);
+
+	struct pgn_game info;
+	enum pgn_status status;
+	while ((status = pgn_read_game(reader, game, NULL, &info)) != PGN_END) {
+		++chunk->games;
+		chunk->plies += info.plies;
+		++chunk->results[info.result];
+		if (status == PGN_INVALID) {
+			add_error(chunk, &info);
+			continue;
+		}
+		++chunk->states[game->win];
+		if (!result_matches(info.result, game->win)) ++chunk->mismatches;
+	}
+	chunk->lines = reader->line - 1;
+end:
+	destroy_board(game);
+	free(reader);
+	scan_release();
+}
+
+static const char *find_game_start(const char *c, const char *end) {
+	// a tag section after a blank line starts a new game
+	while (c < end) {
+		const char *newline = memchr(c, '\n', end - c);
+		if (!newline) return end;
+		c = newline + 1;
+		const char *line = c;
+		while (line < end && (*line == '\r' || *line == ' ' || *line == '\t')) ++line;
+		if (line < end && *line == '\n') {
+			// blank line, the game starts at the next line that is not blank
+			while (line < end && (*line == '\n' || *line == '\r' || *line == ' ' || *line == '\t')) ++line;
+			if (line < end && *line == '[') {
+				// keep the whitespace in this chunk so line numbers stay correct
+				while (c < line && line[-1] != '\n') --line;
+				return line;
+			}
+			c = line;
+		}
+	}
+	return end;
+}
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const char *const result_names[] = {
+        [PGN_RESULT_WHITE_WIN] = "1-0",
+        [PGN_RESULT_BLACK_WIN] = "0-1",
+        [PGN_RESULT_DRAW] = "1/2-1/2",
+        [PGN_RESULT_UNKNOWN] = "*",
+};
+
+static const char *const state_names[SCAN_STATES] = {
+        [STATE_NONE] = "No result on the board",
+        [STATE_CHECKMATE_WHITE_WIN] = "Checkmate by white",
+        [STATE_CHECKMATE_BLACK_WIN] = "Checkmate by black",
+        [STATE_STALEMATE] = "Stalemate",
+        [STATE_INSUFFICIENT_MATERIAL] = "Insufficient material",
+        [STATE_SEVENTY_FIVE_MOVE_RULE] = "Seventy-five move rule",
+        [STATE_FIVEFOLD_REPETITION] = "Fivefold repetition",
+};
+
+bool run_pgn_scan(const char *path, unsigned threads, FILE *fp) {
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		perror(path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) < 0) {
+		perror(path);
+		close(fd);
+		return false;
+	}
+	size_t size = st.st_size;
+	const char *data = NULL;
+	if (size > 0) {
+		data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return false;
+		}
+		madvise((void *) data, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	if (threads < 1) threads = 1;
+	size_t chunk_size = size / (threads * SCAN_CHUNKS_PER_THREAD);
+	if (chunk_size < SCAN_MIN_CHUNK_SIZE) chunk_size = SCAN_MIN_CHUNK_SIZE;
+	size_t chunk_count = size / chunk_size + 1;
+	struct scan_chunk *chunks = calloc(chunk_count, sizeof(struct scan_chunk));
+	struct pool *pool = pool_create(threads);
+	bool result = false;
+	if (!chunks || !pool) {
+		fprintf(fp, "Out of memory\n");
+		goto end;
+	}
+
+	double start = get_time();
+	const char *c = data, *end = data + size;
+	size_t used = 0;
+	for (; used < chunk_count && c < end; ++used) {
+		const char *chunk_end = (size_t) (end - c) > chunk_size ? find_game_start(c + chunk_size, end) : end;
+		chunks[used].data = c;
+		chunks[used].length = chunk_end - c;
+		if (used == chunk_count - 1) chunks[used].length = end - c;
+		c += chunks[used].length;
+		if (!pool_submit(pool, scan_chunk, &chunks[used])) scan_chunk(&chunks[used], 0);
+	}
+	pool_wait(pool);
+	double seconds = get_time() - start;
+
+	struct scan_chunk total = {0};
+	size_t line = 0;
+	result = true;
+	for (size_t i = 0; i < used; ++i) {
+		struct scan_chunk *chunk = &chunks[i];
+		total.games += chunk->games;
+		total.plies += chunk->plies;
+		total.mismatches += chunk->mismatches;
+		for (size_t j = 0; j <= PGN_RESULT_DRAW; ++j) total.results[j] += chunk->results[j];
+		for (size_t j = 0; j < SCAN_STATES; ++j) total.states[j] += chunk->states[j];
+		for (size_t j = 0; j < chunk->error_count; ++j) {
+			struct scan_error *error = &chunk->errors[j];
+			fprintf(fp, "%s:%zu: %s%s%s\n", path, line + error->line, error->message, error->token[0] ? " " : "", error->token);
+		}
+		total.error_count += chunk->error_count;
+		if (chunk->out_of_memory) {
+			fprintf(fp, "Out of memory, some games were not played\n");
+			result = false;
+		}
+		line += chunk->lines;
+	}
+	if (total.error_count) result = false;
+
+	fprintf(fp, "\nGames: %zu\n", total.games);
+	fprintf(fp, "Invalid games: %zu\n", total.error_count);
+	fprintf(fp, "Moves: %zu\n", total.plies);
+	fprintf(fp, "Time: %.3fs\n", seconds);
+	if (seconds > 0) {
+		fprintf(fp, "Games/second: %.0f\n", total.games / seconds);
+		fprintf(fp, "Moves/second: %.0f\n", total.plies / seconds);
+	}
+	fprintf(fp, "\nResults:\n");
+	for (size_t i = PGN_RESULT_WHITE_WIN; i <= PGN_RESULT_DRAW; ++i) fprintf(fp, "  %-8s %zu\n", result_names[i], total.results[i]);
+	fprintf(fp, "  %-8s %zu\n", result_names[PGN_RESULT_UNKNOWN], total.results[PGN_RESULT_UNKNOWN]);
+	fprintf(fp, "\nTermination:\n");
+	for (size_t i = 0; i < SCAN_STATES; ++i)
+		if (state_names[i]) fprintf(fp, "  %-23s %zu\n", state_names[i], total.states[i]);
+	fprintf(fp, "Results that do not match the board: %zu\n", total.mismatches);
+
+end:
+	pool_destroy(pool);
+	if (chunks)
+		for (size_t i = 0; i < chunk_count; ++i) free(chunks[i].errors);
+	free(chunks);
+	if (data) munmap((void *) data, size);
+	return result;
+}
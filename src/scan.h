@@ -0,0 +1,9 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <stdbool.h>
+#include <stdio.h>
+
+// replays every game in a PGN file on a thread pool and prints statistics
+// returns false if the file could not be read or any game could not be played
+bool run_pgn_scan(const char *path, unsigned threads, FILE *fp);
+#endif
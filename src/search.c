@@ -0,0 +1,707 @@
+#include "search.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bitboard.h"
+#include "pool.h"
+
+// how often the clock is read, in nodes
+#define SEARCH_CHECK_INTERVAL (2048)
+// half width of the first aspiration window, and the depth it is first used at
+#define SEARCH_ASPIRATION_WINDOW (25)
+#define SEARCH_ASPIRATION_DEPTH (4)
+// number of depth skipping patterns for the helper threads, see iterate
+#define SEARCH_SKIP_PATTERNS (20)
+// history scores stay between -SEARCH_HISTORY_MAX and SEARCH_HISTORY_MAX
+#define SEARCH_HISTORY_MAX (1 << 14)
+
+static const int piece_values[TYPE_PAWN + 1] = {0, 0, 900, 500, 330, 320, 100};
+// game phase weight of each piece, 24 with every piece on the board and 0 with only kings and pawns
+static const int phase_weights[TYPE_PAWN + 1] = {0, 0, 4, 2, 1, 1, 0};
+#define SEARCH_PHASE_MAX (24)
+
+// helper i skips the depths where (depth + skip_phase[i]) / skip_size[i] is odd
+static const uint8_t skip_size[SEARCH_SKIP_PATTERNS] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+static const uint8_t skip_phase[SEARCH_SKIP_PATTERNS] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3, 4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// piece square tables from white's point of view, written with rank 8 at the top so a white piece on sq uses sq ^ 56
+static const int8_t piece_squares[TYPE_PAWN + 1][64] = {
+        [TYPE_KING] = {
+                       -30, -40, -40, -50, -50, -40, -40, -30,
+                       -30, -40, -40, -50, -50, -40, -40, -30,
+                       -30, -40, -40, -50, -50, -40, -40, -30,
+                       -30, -40, -40, -50, -50, -40, -40, -30,
+                       -20, -30, -30, -40, -40, -30, -30, -20,
+                       -10, -20, -20, -20, -20, -20, -20, -10,
+                       20,  20,  0,   0,   0,   0,   20,  20,
+                       20,  30,  10,  0,   0,   10,  30,  20,
+                       },
+        [TYPE_QUEEN] = {
+                       -20, -10, -10, -5,  -5,  -10, -10, -20,
+                       -10, 0,   0,   0,   0,   0,   0,   -10,
+                       -10, 0,   5,   5,   5,   5,   0,   -10,
+                       -5,  0,   5,   5,   5,   5,   0,   -5,
+                       0,   0,   5,   5,   5,   5,   0,   -5,
+                       -10, 5,   5,   5,   5,   5,   0,   -10,
+                       -10, 0,   5,   0,   0,   0,   0,   -10,
+                       -20, -10, -10, -5,  -5,  -10, -10, -20,
+                       },
+        [TYPE_ROOK] = {
+                       0,  0,  0,  0,  0,  0,  0,  0,
+                       5,  10, 10, 10, 10, 10, 10, 5,
+                       -5, 0,  0,  0,  0,  0,  0,  -5,
+                       -5, 0,  0,  0,  0,  0,  0,  -5,
+                       -5, 0,  0,  0,  0,  0,  0,  -5,
+                       -5, 0,  0,  0,  0,  0,  0,  -5,
+                       -5, 0,  0,  0,  0,  0,  0,  -5,
+                       0,  0,  0,  5,  5,  0,  0,  0,
+                       },
+        [TYPE_BISHOP] = {
+                       -20, -10, -10, -10, -10, -10, -10, -20,
+                       -10, 0,   0,   0,   0,   0,   0,   -10,
+                       -10, 0,   5,   10,  10,  5,   0,   -10,
+                       -10, 5,   5,   10,  10,  5,   5,   -10,
+                       -10, 0,   10,  10,  10,  10,  0,   -10,
+                       -10, 10,  10,  10,  10,  10,  10,  -10,
+                       -10, 5,   0,   0,   0,   0,   5,   -10,
+                       -20, -10, -10, -10, -10, -10, -10, -20,
+                       },
+        [TYPE_KNIGHT] = {
+                       -50, -40, -30, -30, -30, -30, -40, -50,
+                       -40, -20, 0,   0,   0,   0,   -20, -40,
+                       -30, 0,   10,  15,  15,  10,  0,   -30,
+                       -30, 5,   15,  20,  20,  15,  5,   -30,
+                       -30, 0,   15,  20,  20,  15,  0,   -30,
+                       -30, 5,   10,  15,  15,  10,  5,   -30,
+                       -40, -20, 0,   5,   5,   0,   -20, -40,
+                       -50, -40, -30, -30, -30, -30, -40, -50,
+                       },
+        [TYPE_PAWN] = {
+                       0,  0,  0,   0,   0,   0,   0,  0,
+                       50, 50, 50,  50,  50,  50,  50, 50,
+                       10, 10, 20,  30,  30,  20,  10, 10,
+                       5,  5,  10,  25,  25,  10,  5,  5,
+                       0,  0,  0,   20,  20,  0,   0,  0,
+                       5,  -5, -10, 0,   0,   -10, -5, 5,
+                       5,  10, 10,  -20, -20, 10,  10, 5,
+                       0,  0,  0,   0,   0,   0,   0,  0,
+                       },
+};
+
+// the king moves to the centre once the pieces are traded, blended with the table above by the game phase
+static const int8_t king_endgame_squares[64] = {
+        -50, -40, -30, -20, -20, -30, -40, -50,
+        -30, -20, -10, 0,   0,   -10, -20, -30,
+        -30, -10, 20,  30,  30,  20,  -10, -30,
+        -30, -10, 30,  40,  40,  30,  -10, -30,
+        -30, -10, 30,  40,  40,  30,  -10, -30,
+        -30, -10, 20,  30,  30,  20,  -10, -30,
+        -30, -30, 0,   0,   0,   0,   -30, -30,
+        -50, -30, -30, -30, -30, -30, -30, -50,
+};
+
+// state shared by the threads of one search
+struct search_shared {
+	struct search_limits limits;
+	struct tt *tt;
+	double start, deadline;
+	atomic_bool stop;
+	_Atomic uint64_t nodes; // added to in batches of SEARCH_CHECK_INTERVAL
+};
+
+// state of one search thread, every thread has its own position and tables
+struct search_state {
+	struct search_shared *shared;
+	struct game *game;
+	unsigned index; // 0 for the main thread, which keeps time and reports the search
+	uint64_t nodes;
+	bool stop;
+	// triangular table of principal variations, pv[ply] is the best line found from that ply
+	uint16_t pv[SEARCH_MAX_PLY + 1][SEARCH_MAX_PLY + 1];
+	uint8_t pv_length[SEARCH_MAX_PLY + 1];
+	uint16_t root_pv[SEARCH_MAX_PLY]; // best line of the last finished iteration, tried first in the next
+	uint8_t root_pv_length;
+	bool follow_pv; // still on the last iteration's best line
+	struct search_result result; // from the last finished iteration
+
+	// move ordering, see struct move_picker
+	uint16_t killers[SEARCH_MAX_PLY + 1][2]; // quiet moves that caused a cutoff at each ply
+	uint16_t counters[64][64];               // quiet move that refuted each opponent move, by its from and to squares
+	int32_t history[2][64][64];              // how often each quiet move caused a cutoff, by color, from and to squares
+};
+
+// moves are tried in stages, and each stage's moves are only generated when it is reached
+// so a cutoff on the hash move, the most common case, needs no move generation at all
+struct move_picker {
+	enum pick_stage {
+		PICK_HASH,
+		PICK_CAPTURES_GENERATE,
+		PICK_CAPTURES,
+		PICK_KILLERS,
+		PICK_COUNTER,
+		PICK_QUIETS_GENERATE,
+		PICK_QUIETS,
+		PICK_BAD_CAPTURES,
+		PICK_DONE,
+	} stage;
+	bool captures_only; // for the quiescence search
+	uint16_t hash_move, killers[2], counter;
+	uint16_t moves[CHESS_MAX_MOVES];
+	int32_t scores[CHESS_MAX_MOVES];
+	size_t count, next;
+	uint16_t bad_captures[CHESS_MAX_MOVES]; // captures that lose material, tried after the quiet moves
+	size_t bad_count, bad_next;
+	uint8_t killer_index;
+};
+
+static double get_time(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int evaluate(struct game *game) {
+	int phase = 0;
+	for (uint8_t type = TYPE_QUEEN; type <= TYPE_KNIGHT; ++type)
+		phase += phase_weights[type] * (game->piece_count[COLOR_WHITE][type] + game->piece_count[COLOR_BLACK][type]);
+	if (phase > SEARCH_PHASE_MAX) phase = SEARCH_PHASE_MAX;
+
+	int score[2] = {0, 0};
+	for (uint8_t color = 0; color < 2; ++color) {
+		// flip the square so both colors read the tables from their own side
+		uint8_t flip = color == COLOR_WHITE ? 56 : 0;
+		for (uint8_t type = TYPE_KING; type <= TYPE_PAWN; ++type) {
+			uint64_t pieces = game->pieces[type] & game->colors[color];
+			score[color] += piece_values[type] * bb_count(pieces);
+			while (pieces) {
+				uint8_t sq = bb_pop(&pieces) ^ flip;
+				if (type == TYPE_KING)
+					score[color] += (piece_squares[type][sq] * phase + king_endgame_squares[sq] * (SEARCH_PHASE_MAX - phase)) / SEARCH_PHASE_MAX;
+				else
+					score[color] += piece_squares[type][sq];
+			}
+		}
+	}
+	int white = score[COLOR_WHITE] - score[COLOR_BLACK];
+	return game->active_color == COLOR_WHITE ? white : -white;
+}
+
+int see(struct game *game, uint16_t move) {
+	// the pieces that capture are taken out of a copy of the occupancy, so sliders behind them join in
+	uint8_t from = PACKED_FROM(move), to = PACKED_TO(move), flags = PACKED_FLAGS(move);
+	if (flags == MOVE_FLAG_CASTLE_KING || flags == MOVE_FLAG_CASTLE_QUEEN) return 0;
+	struct piece piece = game->board[SQUARE_Y(from)][SQUARE_X(from)];
+	enum piece_type on_square = piece.type; // piece the next capture takes
+	uint64_t occupied = game->occupied ^ BIT(from);
+
+	int gain[33]; // gain[i] is the material won by the player making capture i if the sequence stopped after it
+	gain[0] = piece_values[game->board[SQUARE_Y(to)][SQUARE_X(to)].type];
+	if (flags == MOVE_FLAG_EN_PASSANT) {
+		gain[0] = piece_values[TYPE_PAWN];
+		occupied ^= BIT(SQUARE(SQUARE_X(to), SQUARE_Y(from)));
+	}
+	if (flags & MOVE_FLAG_PROMOTION) {
+		on_square = PACKED_PROMOTION(move);
+		gain[0] += piece_values[on_square] - piece_values[TYPE_PAWN];
+	}
+
+	uint64_t bishops = game->pieces[TYPE_BISHOP] | game->pieces[TYPE_QUEEN];
+	uint64_t rooks = game->pieces[TYPE_ROOK] | game->pieces[TYPE_QUEEN];
+	uint64_t attackers = attackers_to(game, to, occupied) & occupied;
+	enum piece_color color = piece.color;
+	uint8_t captures = 0;
+	while (true) {
+		color = get_opposite_color(color);
+		uint64_t own = attackers & game->colors[color];
+		if (!own) break;
+		// recapture with the least valuable piece
+		enum piece_type type = TYPE_PAWN;
+		while (!(own & game->pieces[type])) --type;
+		occupied ^= BIT(bb_first(own & game->pieces[type]));
+		attackers = (attackers | (bishop_attacks(to, occupied) & bishops) | (rook_attacks(to, occupied) & rooks)) & occupied;
+		// the king cannot capture onto a square that is still attacked
+		if (type == TYPE_KING && (attackers & game->colors[get_opposite_color(color)])) break;
+
+		++captures;
+		gain[captures] = piece_values[on_square] - gain[captures - 1];
+		on_square = type;
+		// a capture that is worse than stopping even if it is not answered is never made, so the sequence ends
+		if (gain[captures] < -gain[captures - 1]) break;
+	}
+	// each player can stop capturing when the rest of the sequence loses
+	for (; captures > 0; --captures)
+		if (-gain[captures] < gain[captures - 1]) gain[captures - 1] = -gain[captures];
+	return gain[0];
+}
+
+static void check_limits(struct search_state *state) {
+	struct search_shared *shared = state->shared;
+	if (atomic_load_explicit(&shared->stop, memory_order_relaxed)) {
+		state->stop = true;
+		return;
+	}
+	if (state->nodes % SEARCH_CHECK_INTERVAL) return;
+	uint64_t nodes = atomic_fetch_add_explicit(&shared->nodes, SEARCH_CHECK_INTERVAL, memory_order_relaxed) + SEARCH_CHECK_INTERVAL;
+	bool stop = shared->limits.nodes && nodes >= shared->limits.nodes;
+	if (state->index == 0 && shared->limits.time && get_time() >= shared->deadline) stop = true;
+	if (stop) {
+		atomic_store_explicit(&shared->stop, true, memory_order_relaxed);
+		state->stop = true;
+	}
+}
+
+static bool is_draw(struct game *game) {
+	// one repetition is enough to score a draw, since the players could repeat it again
+	if (count_repetitions(game) > 0 || insufficient_material(game)) return true;
+	if (game->half_move < 100) return false;
+	// unless the move that reached the fifty move limit gave mate
+	uint16_t moves[CHESS_MAX_MOVES];
+	return !in_check(game) || generate_packed_moves(game, moves, CHESS_MAX_MOVES) > 0;
+}
+
+static void init_picker(struct search_state *state, struct move_picker *picker, uint16_t hash_move, uint8_t ply, bool captures_only) {
+	struct game *game = state->game;
+	picker->stage = PICK_HASH;
+	picker->captures_only = captures_only;
+	picker->hash_move = is_legal_move(game, hash_move) ? hash_move : 0;
+	picker->killers[0] = state->killers[ply][0];
+	picker->killers[1] = state->killers[ply][1];
+	picker->counter = 0;
+	if (game->undo_count) {
+		uint16_t previous = game->undo_stack[game->undo_count - 1].move;
+		picker->counter = state->counters[PACKED_FROM(previous)][PACKED_TO(previous)];
+	}
+	picker->killer_index = 0;
+	picker->bad_count = picker->bad_next = 0;
+}
+
+static void score_captures(struct game *game, struct move_picker *picker) {
+	// most valuable victim first, then least valuable attacker
+	for (size_t i = 0; i < picker->count; ++i) {
+		uint16_t move = picker->moves[i];
+		uint8_t from = PACKED_FROM(move), to = PACKED_TO(move), flags = PACKED_FLAGS(move);
+		enum piece_type victim = flags == MOVE_FLAG_EN_PASSANT ? TYPE_PAWN : game->board[SQUARE_Y(to)][SQUARE_X(to)].type;
+		enum piece_type attacker = game->board[SQUARE_Y(from)][SQUARE_X(from)].type;
+		picker->scores[i] = piece_values[victim] * 8 - piece_values[attacker] / 8;
+		if (flags & MOVE_FLAG_PROMOTION) picker->scores[i] += piece_values[PACKED_PROMOTION(move)];
+	}
+}
+
+static void score_quiets(struct search_state *state, struct move_picker *picker) {
+	int32_t(*history)[64] = state->history[state->game->active_color];
+	for (size_t i = 0; i < picker->count; ++i) picker->scores[i] = history[PACKED_FROM(picker->moves[i])][PACKED_TO(picker->moves[i])];
+}
+
+static uint16_t pick_best(struct move_picker *picker) {
+	// selection sort one move at a time, a cutoff usually comes before the list is sorted
+	if (picker->next >= picker->count) return 0;
+	size_t best = picker->next;
+	for (size_t i = best + 1; i < picker->count; ++i)
+		if (picker->scores[i] > picker->scores[best]) best = i;
+	uint16_t move = picker->moves[best];
+	int32_t score = picker->scores[best];
+	picker->moves[best] = picker->moves[picker->next];
+	picker->scores[best] = picker->scores[picker->next];
+	picker->moves[picker->next] = move;
+	picker->scores[picker->next++] = score;
+	return move;
+}
+
+static bool loses_material(struct game *game, uint16_t move) {
+	// taking a piece worth at least the capturing piece cannot lose material, which skips most exchange evaluations
+	uint8_t from = PACKED_FROM(move), to = PACKED_TO(move), flags = PACKED_FLAGS(move);
+	enum piece_type victim = flags == MOVE_FLAG_EN_PASSANT ? TYPE_PAWN : game->board[SQUARE_Y(to)][SQUARE_X(to)].type;
+	if (!(flags & MOVE_FLAG_PROMOTION) && piece_values[victim] >= piece_values[game->board[SQUARE_Y(from)][SQUARE_X(from)].type]) return false;
+	return see(game, move) < 0;
+}
+
+static bool is_quiet(uint16_t move) {
+	return !(PACKED_FLAGS(move) & (MOVE_FLAG_CAPTURE | MOVE_FLAG_PROMOTION));
+}
+
+static uint16_t next_move(struct search_state *state, struct move_picker *picker) {
+	struct game *game = state->game;
+	uint16_t move;
+	switch (picker->stage) {
+		case PICK_HASH:
+			picker->stage = PICK_CAPTURES_GENERATE;
+			if (picker->hash_move && (!picker->captures_only || !is_quiet(picker->hash_move))) return picker->hash_move;
+			// fall through
+		case PICK_CAPTURES_GENERATE:
+			picker->count = generate_staged_moves(game, MOVES_CAPTURES, picker->moves, CHESS_MAX_MOVES);
+			picker->next = 0;
+			score_captures(game, picker);
+			picker->stage = PICK_CAPTURES;
+			// fall through
+		case PICK_CAPTURES:
+			while ((move = pick_best(picker))) {
+				if (move == picker->hash_move) continue;
+				// captures that lose material wait until after the quiet moves, the quiescence search leaves them out
+				if (loses_material(game, move)) {
+					if (!picker->captures_only) picker->bad_captures[picker->bad_count++] = move;
+					continue;
+				}
+				return move;
+			}
+			if (picker->captures_only) {
+				picker->stage = PICK_DONE;
+				return 0;
+			}
+			picker->stage = PICK_KILLERS;
+			// fall through
+		case PICK_KILLERS:
+			while (picker->killer_index < 2) {
+				move = picker->killers[picker->killer_index++];
+				if (move && move != picker->hash_move && is_quiet(move) && is_legal_move(game, move)) return move;
+			}
+			picker->stage = PICK_COUNTER;
+			// fall through
+		case PICK_COUNTER:
+			picker->stage = PICK_QUIETS_GENERATE;
+			move = picker->counter;
+			if (move && move != picker->hash_move && move != picker->killers[0] && move != picker->killers[1] && is_quiet(move) && is_legal_move(game, move))
+				return move;
+			// fall through
+		case PICK_QUIETS_GENERATE:
+			picker->count = generate_staged_moves(game, MOVES_QUIETS, picker->moves, CHESS_MAX_MOVES);
+			picker->next = 0;
+			score_quiets(state, picker);
+			picker->stage = PICK_QUIETS;
+			// fall through
+		case PICK_QUIETS:
+			while ((move = pick_best(picker)))
+				if (move != picker->hash_move && move != picker->killers[0] && move != picker->killers[1] && move != picker->counter) return move;
+			picker->stage = PICK_BAD_CAPTURES;
+			// fall through
+		case PICK_BAD_CAPTURES:
+			if (picker->bad_next < picker->bad_count) return picker->bad_captures[picker->bad_next++];
+			picker->stage = PICK_DONE;
+			// fall through
+		default:
+			return 0;
+	}
+}
+
+static void update_history(int32_t *entry, int32_t bonus) {
+	// the closer the score is to the limit in the bonus's direction, the less it moves, so it never passes the limit
+	int32_t size = bonus < 0 ? -bonus : bonus;
+	*entry += bonus - *entry * size / SEARCH_HISTORY_MAX;
+}
+
+static void update_quiet_stats(struct search_state *state, uint16_t move, uint8_t ply, int depth, const uint16_t *tried, size_t tried_count) {
+	// a quiet move that caused a cutoff becomes a killer, the counter to the opponent's last move and gains history
+	// the quiet moves tried before it lose history
+	struct game *game = state->game;
+	if (state->killers[ply][0] != move) {
+		state->killers[ply][1] = state->killers[ply][0];
+		state->killers[ply][0] = move;
+	}
+	if (game->undo_count) {
+		uint16_t previous = game->undo_stack[game->undo_count - 1].move;
+		state->counters[PACKED_FROM(previous)][PACKED_TO(previous)] = move;
+	}
+	int32_t(*history)[64] = state->history[game->active_color];
+	int32_t bonus = depth * depth < SEARCH_HISTORY_MAX ? depth * depth : SEARCH_HISTORY_MAX;
+	update_history(&history[PACKED_FROM(move)][PACKED_TO(move)], bonus);
+	for (size_t i = 0; i < tried_count; ++i) update_history(&history[PACKED_FROM(tried[i])][PACKED_TO(tried[i])], -bonus);
+}
+
+static int quiescence(struct search_state *state, int alpha, int beta, uint8_t ply) {
+	struct game *game = state->game;
+	++state->nodes;
+	check_limits(state);
+	if (state->stop) return 0;
+	state->pv_length[ply] = 0;
+	state->follow_pv = false;
+	if (is_draw(game)) return 0;
+
+	// captures are optional, the player can stand pat on the static evaluation unless in check
+	bool check = in_check(game);
+	if (!check) {
+		int stand_pat = evaluate(game);
+		if (stand_pat >= beta || ply >= SEARCH_MAX_PLY) return stand_pat;
+		if (stand_pat > alpha) alpha = stand_pat;
+	}
+
+	if (ply >= SEARCH_MAX_PLY) return evaluate(game);
+
+	// every move is searched to get out of check
+	struct move_picker picker;
+	init_picker(state, &picker, 0, ply, !check);
+	size_t searched = 0;
+	for (uint16_t move; (move = next_move(state, &picker));) {
+		make_move(game, move);
+		int score = -quiescence(state, -beta, -alpha, ply + 1);
+		unmake_move(game);
+		++searched;
+		if (state->stop) return 0;
+		if (score >= beta) return score;
+		if (score > alpha) alpha = score;
+	}
+	if (check && !searched) return -SEARCH_MATE + ply;
+	return alpha;
+}
+
+// mate scores are stored relative to the position rather than the root, so they stay right when reached by another path
+static int score_to_tt(int score, uint8_t ply) {
+	if (score > SEARCH_MATE - SEARCH_MAX_PLY) return score + ply;
+	if (score < -SEARCH_MATE + SEARCH_MAX_PLY) return score - ply;
+	return score;
+}
+
+static int score_from_tt(int score, uint8_t ply) {
+	if (score > SEARCH_MATE - SEARCH_MAX_PLY) return score - ply;
+	if (score < -SEARCH_MATE + SEARCH_MAX_PLY) return score + ply;
+	return score;
+}
+
+static int negamax(struct search_state *state, int alpha, int beta, int depth, uint8_t ply) {
+	struct game *game = state->game;
+	state->pv_length[ply] = 0;
+	if (ply > 0 && is_draw(game)) return 0;
+	bool check = in_check(game);
+	if (check) ++depth; // look further when in check, so mates are not pushed past the horizon
+	if (depth <= 0 || ply >= SEARCH_MAX_PLY) return quiescence(state, alpha, beta, ply);
+
+	++state->nodes;
+	check_limits(state);
+	if (state->stop) return 0;
+
+	// a mate found closer to the root cannot be improved on
+	if (alpha < -SEARCH_MATE + ply) alpha = -SEARCH_MATE + ply;
+	if (beta > SEARCH_MATE - ply - 1) beta = SEARCH_MATE - ply - 1;
+	if (alpha >= beta) return alpha;
+
+	// a deep enough entry can end the search of the position, except at the root, which needs a move
+	struct tt_hit hit = {0};
+	struct tt *tt = state->shared->tt;
+	if (tt && tt_probe(tt, game->key, &hit) && ply > 0 && hit.depth >= depth) {
+		int score = score_from_tt(hit.score, ply);
+		if (hit.bound == TT_BOUND_EXACT || (hit.bound == TT_BOUND_LOWER && score >= beta) || (hit.bound == TT_BOUND_UPPER && score <= alpha))
+			return score;
+	}
+
+	// the last iteration's best line is tried first while the search is still on it, otherwise the table's move
+	uint16_t pv_move = state->follow_pv && ply < state->root_pv_length ? state->root_pv[ply] : 0;
+	struct move_picker picker;
+	init_picker(state, &picker, pv_move ? pv_move : hit.move, ply, false);
+	state->follow_pv = pv_move && picker.hash_move == pv_move;
+
+	int best = -SEARCH_INFINITE, original_alpha = alpha;
+	uint16_t best_move = 0;
+	uint16_t quiets[CHESS_MAX_MOVES]; // quiet moves searched without a cutoff
+	size_t searched = 0, quiet_count = 0;
+	for (uint16_t move; (move = next_move(state, &picker));) {
+		make_move(game, move);
+		// start loading the child's entry while its own checks run, a child at depth 0 goes to quiescence without probing
+		if (tt && depth > 1) tt_prefetch(tt, game->key);
+		int score;
+		if (searched == 0) {
+			score = -negamax(state, -beta, -alpha, depth - 1, ply + 1);
+		} else {
+			// principal variation search, the other moves only have to be proven worse than the first with a null window
+			score = -negamax(state, -alpha - 1, -alpha, depth - 1, ply + 1);
+			if (score > alpha && score < beta) score = -negamax(state, -beta, -alpha, depth - 1, ply + 1);
+		}
+		unmake_move(game);
+		++searched;
+		if (state->stop) return 0;
+
+		if (score > best) best = score;
+		if (score > alpha) {
+			alpha = score;
+			best_move = move;
+			state->pv[ply][0] = move;
+			memcpy(state->pv[ply] + 1, state->pv[ply + 1], state->pv_length[ply + 1] * sizeof(uint16_t));
+			state->pv_length[ply] = state->pv_length[ply + 1] + 1;
+		}
+		if (alpha >= beta) {
+			if (is_quiet(move)) update_quiet_stats(state, move, ply, depth, quiets, quiet_count);
+			break;
+		}
+		if (is_quiet(move)) quiets[quiet_count++] = move;
+	}
+	if (!searched) return check ? -SEARCH_MATE + ply : 0;
+	if (tt) {
+		enum tt_bound bound = best >= beta ? TT_BOUND_LOWER : best > original_alpha ? TT_BOUND_EXACT : TT_BOUND_UPPER;
+		tt_store(tt, game->key, depth, bound, score_to_tt(best, ply), best_move);
+	}
+	return best;
+}
+
+static void print_iteration(struct search_state *state, struct search_result *result, FILE *fp) {
+	char score[16];
+	search_score_string(result->score, score, sizeof(score));
+	uint64_t nodes = atomic_load_explicit(&state->shared->nodes, memory_order_relaxed) + state->nodes % SEARCH_CHECK_INTERVAL;
+	fprintf(fp, "depth %u score %s nodes %llu time %.0f pv", result->depth, score, (unsigned long long) nodes, result->seconds * 1000);
+	for (uint8_t i = 0; i < result->pv_length; ++i) {
+		char uci[8];
+		move_to_uci(result->pv[i], uci);
+		fprintf(fp, " %s", uci);
+	}
+	fprintf(fp, "\n");
+}
+
+static void iterate(struct search_state *state, FILE *fp) {
+	struct search_shared *shared = state->shared;
+	struct search_result *result = &state->result;
+	uint8_t max_depth = shared->limits.depth && shared->limits.depth < SEARCH_MAX_PLY ? shared->limits.depth : SEARCH_MAX_PLY;
+	int score = 0;
+	for (uint8_t depth = 1; depth <= max_depth; ++depth) {
+		// helpers skip blocks of depths, each with its own block size and offset, so they are spread over the depths
+		if (state->index > 0) {
+			unsigned skip = (state->index - 1) % SEARCH_SKIP_PATTERNS;
+			if ((depth + skip_phase[skip]) / skip_size[skip] % 2) continue;
+		}
+		// search a narrow window around the last score first, and widen it on the side it fails
+		int delta = SEARCH_ASPIRATION_WINDOW;
+		int alpha = -SEARCH_INFINITE, beta = SEARCH_INFINITE;
+		if (depth >= SEARCH_ASPIRATION_DEPTH && !SEARCH_IS_MATE(score)) {
+			alpha = score - delta;
+			beta = score + delta;
+		}
+		while (true) {
+			state->follow_pv = true;
+			score = negamax(state, alpha, beta, depth, 0);
+			if (state->stop) break;
+			if (score <= alpha) alpha = alpha - delta < -SEARCH_INFINITE ? -SEARCH_INFINITE : alpha - delta;
+			else if (score >= beta)
+				beta = beta + delta > SEARCH_INFINITE ? SEARCH_INFINITE : beta + delta;
+			else
+				break;
+			delta *= 2;
+		}
+		// an unfinished iteration is thrown away
+		if (state->stop) break;
+
+		memcpy(state->root_pv, state->pv[0], state->pv_length[0] * sizeof(uint16_t));
+		state->root_pv_length = state->pv_length[0];
+		result->score = score;
+		result->depth = depth;
+		if (state->pv_length[0]) result->move = state->pv[0][0];
+		memcpy(result->pv, state->root_pv, state->root_pv_length * sizeof(uint16_t));
+		result->pv_length = state->root_pv_length;
+		if (state->index != 0) continue;
+
+		// only the main thread decides when the search is over
+		result->seconds = get_time() - shared->start;
+		if (fp) print_iteration(state, result, fp);
+		// a forced mate will not be found any faster by looking deeper
+		if (SEARCH_IS_MATE(score) && SEARCH_MATE - abs(score) <= depth) break;
+		// the next iteration would most likely not finish in the remaining time
+		if (shared->limits.time && result->seconds > shared->limits.time / 2000.0) break;
+	}
+	if (state->index == 0) atomic_store_explicit(&shared->stop, true, memory_order_relaxed);
+}
+
+static void run_helper(void *data, unsigned worker) {
+	(void) worker;
+	iterate(data, NULL);
+}
+
+static struct search_state *vote(struct search_state *states, unsigned threads) {
+	// every thread votes for its best move, weighted by its depth and by how much better its score is than the worst one
+	int worst = SEARCH_INFINITE;
+	for (unsigned i = 0; i < threads; ++i)
+		if (states[i].result.depth && states[i].result.score < worst) worst = states[i].result.score;
+	int64_t votes[SEARCH_MAX_THREADS] = {0};
+	for (unsigned i = 0; i < threads; ++i) {
+		struct search_result *result = &states[i].result;
+		if (!result->depth) continue;
+		for (unsigned j = 0; j < threads; ++j)
+			if (states[j].result.move == result->move) votes[j] += (int64_t) (result->score - worst + 10) * result->depth;
+	}
+
+	struct search_state *best = &states[0];
+	for (unsigned i = 1; i < threads; ++i) {
+		struct search_result *result = &states[i].result, *best_result = &best->result;
+		if (!result->depth) continue;
+		// a mate found by any thread is played, the shortest one if there are several
+		bool mate = SEARCH_IS_MATE(result->score) && result->score > 0;
+		bool best_mate = SEARCH_IS_MATE(best_result->score) && best_result->score > 0;
+		if (mate || best_mate) {
+			if (result->score > best_result->score) best = &states[i];
+		} else if (votes[i] > votes[best - states] || !best_result->depth) {
+			best = &states[i];
+		}
+	}
+	return best;
+}
+
+bool search(struct game *game, struct search_limits limits, unsigned threads, struct tt *tt, struct search_result *result, FILE *fp) {
+	uint16_t moves[CHESS_MAX_MOVES];
+	size_t count = generate_packed_moves(game, moves, CHESS_MAX_MOVES);
+	memset(result, 0, sizeof(struct search_result));
+	if (!count) return false;
+	result->move = moves[0];
+
+	if (threads < 1) threads = 1;
+	if (threads > SEARCH_MAX_THREADS) threads = SEARCH_MAX_THREADS;
+	// the states hold the principal variation and move ordering tables, which are too big for the stack of a pool thread
+	struct search_shared shared = {.limits = limits, .tt = tt, .start = get_time()};
+	shared.deadline = shared.start + limits.time / 1000.0;
+	struct search_state *states = calloc(threads, sizeof(struct search_state));
+	if (!states) return true; // still a legal move
+	if (tt) tt_new_search(tt);
+
+	// each helper searches its own copy of the position, with fewer helpers if memory runs out
+	states[0].game = game;
+	for (unsigned i = 1; i < threads; ++i) {
+		if (!(states[i].game = copy_board(game))) {
+			threads = i;
+			break;
+		}
+	}
+	struct pool *pool = threads > 1 ? pool_create(threads - 1) : NULL;
+	for (unsigned i = 0; i < threads; ++i) {
+		states[i].shared = &shared;
+		states[i].index = i;
+		states[i].result.move = moves[0];
+		if (i > 0 && (!pool || !pool_submit(pool, run_helper, &states[i]))) states[i].stop = true;
+	}
+	iterate(&states[0], fp);
+	pool_destroy(pool);
+
+	*result = vote(states, threads)->result;
+	result->nodes = atomic_load_explicit(&shared.nodes, memory_order_relaxed);
+	for (unsigned i = 0; i < threads; ++i) result->nodes += states[i].nodes % SEARCH_CHECK_INTERVAL;
+	result->seconds = get_time() - shared.start;
+	for (unsigned i = 1; i < threads; ++i) destroy_board(states[i].game);
+	free(states);
+	return true;
+}
+
+bool parse_search_limits(const char *str, struct search_limits *limits) {
+	*limits = (struct search_limits){0};
+	while (*str) {
+		const char *value = strchr(str, '=');
+		if (!value) return false;
+		size_t name_length = value - str;
+		++value;
+		char *end;
+		unsigned long long number = strtoull(value, &end, 10);
+		if (end == value || (*end && *end != ',')) return false;
+		if (name_length == 5 && strncmp(str, "depth", 5) == 0 && number >= 1 && number <= SEARCH_MAX_PLY)
+			limits->depth = number;
+		else if (name_length == 5 && strncmp(str, "nodes", 5) == 0 && number >= 1)
+			limits->nodes = number;
+		else if (name_length == 4 && strncmp(str, "time", 4) == 0 && number >= 1 && number <= UINT32_MAX)
+			limits->time = number;
+		else
+			return false;
+		str = *end ? end + 1 : end;
+	}
+	return true;
+}
+
+void search_score_string(int score, char *str, size_t size) {
+	if (SEARCH_IS_MATE(score)) {
+		// plies to mate, counted in moves of the player to move
+		int plies = SEARCH_MATE - abs(score);
+		snprintf(str, size, "mate %d", score > 0 ? (plies + 1) / 2 : -(plies / 2));
+	} else {
+		snprintf(str, size, "cp %d", score);
+	}
+}
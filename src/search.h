@@ -0,0 +1,52 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "chess.h"
+#include "tt.h"
+
+#define SEARCH_MAX_PLY (64)
+#define SEARCH_MAX_THREADS (1024)
+// scores are in centipawns for the player to move, a mate in n plies scores SEARCH_MATE - n
+#define SEARCH_MATE (32000)
+#define SEARCH_INFINITE (32500)
+#define SEARCH_IS_MATE(score_) ((score_) > SEARCH_MATE - SEARCH_MAX_PLY || (score_) < -SEARCH_MATE + SEARCH_MAX_PLY)
+
+// the search stops at whichever limit it reaches first, 0 means no limit
+// with no limits at all it searches to SEARCH_MAX_PLY
+struct search_limits {
+	uint8_t depth;
+	uint64_t nodes;
+	uint32_t time; // milliseconds
+};
+
+struct search_result {
+	uint16_t move; // 0 if there are no legal moves
+	int score;
+	uint8_t depth; // last depth searched to the end
+	uint64_t nodes;
+	double seconds;
+	uint16_t pv[SEARCH_MAX_PLY];
+	uint8_t pv_length;
+};
+
+// static evaluation of the position for the player to move
+int evaluate(struct game *game);
+// static exchange evaluation, the material the player to move wins with the move if both players keep capturing on its square
+// each player recaptures with their least valuable piece and can stop at any point, pins are ignored and the board is not changed
+// a quiet move scores below 0 if the piece can be taken for less than it is worth
+int see(struct game *game, uint16_t move);
+// iterative deepening alpha-beta search, nothing is allocated per node
+// with more than one thread, helpers search copies of the position at the same time sharing tt, and the threads vote on the move
+// tt may be NULL, otherwise it can be shared with other searches running at the same time
+// prints a line for each depth to fp if it is not NULL, the game is left as it was
+// returns false if there are no legal moves
+bool search(struct game *game, struct search_limits limits, unsigned threads, struct tt *tt, struct search_result *result, FILE *fp);
+// parses limits such as depth=8,nodes=100000,time=500, returns false if invalid
+bool parse_search_limits(const char *str, struct search_limits *limits);
+// writes the score as cp 35, or mate -3 counted in moves
+void search_score_string(int score, char *str, size_t size);
+#endif
@@ -0,0 +1,126 @@
+#include "tt.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// data layout, the depth and generation are at the same place for every entry so they can be replaced the same way
+//   bits 0-7    depth
+//   bits 8-13   generation
+//   bits 14-15  enum tt_bound
+//   bits 16-63  search entries: move in 16-31, score in 32-47, perft entries: the node count
+#define TT_DEPTH(data_) ((uint8_t) (data_))
+#define TT_GENERATION(data_) ((uint8_t) (((data_) >> 8) & 0x3F))
+#define TT_BOUND(data_) ((enum tt_bound) (((data_) >> 14) & 3))
+#define TT_MOVE(data_) ((uint16_t) ((data_) >> 16))
+#define TT_SCORE(data_) ((int16_t) ((data_) >> 32))
+#define TT_COUNT(data_) ((data_) >> 16)
+#define TT_COUNT_MAX (((uint64_t) 1 << 48) - 1)
+#define TT_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+
+// perft keys are salted by depth so they never match a search entry or a count at another depth
+#define TT_PERFT_KEY(key_, depth_) ((key_) ^ (0x9E3779B97F4A7C15ULL * ((depth_) + 1)))
+
+bool tt_create(struct tt *tt, size_t megabytes) {
+	memset(tt, 0, sizeof(struct tt));
+	if (megabytes < 1) megabytes = 1;
+	if (megabytes > TT_MAX_SIZE) megabytes = TT_MAX_SIZE;
+	// the largest power of two number of buckets that fits, so the index is the low bits of the key
+	size_t buckets = 1;
+	while (buckets * 2 * sizeof(struct tt_bucket) <= megabytes << 20) buckets *= 2;
+	size_t size = buckets * sizeof(struct tt_bucket);
+	// align to the huge page size so the kernel can back the whole table with huge pages
+	size_t alignment = size >= TT_HUGE_PAGE_SIZE ? TT_HUGE_PAGE_SIZE : _Alignof(struct tt_bucket);
+	tt->buckets = aligned_alloc(alignment, size);
+	if (!tt->buckets) return false;
+#ifdef MADV_HUGEPAGE
+	if (alignment == TT_HUGE_PAGE_SIZE) madvise(tt->buckets, size, MADV_HUGEPAGE);
+#endif
+	tt->mask = buckets - 1;
+	tt->size = size;
+	tt_clear(tt);
+	return true;
+}
+
+void tt_destroy(struct tt *tt) {
+	free(tt->buckets);
+	tt->buckets = NULL;
+}
+
+void tt_clear(struct tt *tt) {
+	// only called when no search is running
+	memset((void *) tt->buckets, 0, tt->size);
+	atomic_store_explicit(&tt->generation, 0, memory_order_relaxed);
+}
+
+void tt_new_search(struct tt *tt) {
+	atomic_fetch_add_explicit(&tt->generation, 1, memory_order_relaxed);
+}
+
+static uint8_t generation(struct tt *tt) {
+	return atomic_load_explicit(&tt->generation, memory_order_relaxed) & 0x3F;
+}
+
+static bool find(struct tt *tt, uint64_t key, uint64_t *data) {
+	struct tt_entry *entries = tt->buckets[key & tt->mask].entries;
+	for (uint8_t i = 0; i < TT_BUCKET_ENTRIES; ++i) {
+		uint64_t check = atomic_load_explicit(&entries[i].check, memory_order_relaxed);
+		uint64_t value = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+		if ((check ^ value) == key && value) {
+			*data = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+static void store(struct tt *tt, uint64_t key, uint64_t data) {
+	struct tt_entry *entries = tt->buckets[key & tt->mask].entries;
+	// replace the same position, or else the entry worth least, which is the shallowest from the oldest search
+	struct tt_entry *replace = NULL;
+	int worst = 0;
+	for (uint8_t i = 0; i < TT_BUCKET_ENTRIES; ++i) {
+		uint64_t check = atomic_load_explicit(&entries[i].check, memory_order_relaxed);
+		uint64_t value = atomic_load_explicit(&entries[i].data, memory_order_relaxed);
+		if ((check ^ value) == key) {
+			replace = &entries[i];
+			break;
+		}
+		uint8_t age = (generation(tt) - TT_GENERATION(value)) & 0x3F;
+		int worth = TT_DEPTH(value) - 8 * age;
+		if (!replace || worth < worst) {
+			replace = &entries[i];
+			worst = worth;
+		}
+	}
+	atomic_store_explicit(&replace->check, key ^ data, memory_order_relaxed);
+	atomic_store_explicit(&replace->data, data, memory_order_relaxed);
+}
+
+bool tt_probe(struct tt *tt, uint64_t key, struct tt_hit *hit) {
+	uint64_t data;
+	if (!find(tt, key, &data) || TT_BOUND(data) == TT_BOUND_NONE) return false;
+	hit->move = TT_MOVE(data);
+	hit->score = TT_SCORE(data);
+	hit->depth = TT_DEPTH(data);
+	hit->bound = TT_BOUND(data);
+	return true;
+}
+
+void tt_store(struct tt *tt, uint64_t key, uint8_t depth, enum tt_bound bound, int score, uint16_t move) {
+	uint64_t old;
+	if (!move && find(tt, key, &old) && TT_BOUND(old) != TT_BOUND_NONE) move = TT_MOVE(old);
+	uint64_t data = depth | (uint64_t) generation(tt) << 8 | (uint64_t) bound << 14 | (uint64_t) move << 16 | (uint64_t) (uint16_t) score << 32;
+	store(tt, key, data);
+}
+
+bool tt_probe_count(struct tt *tt, uint64_t key, uint8_t depth, uint64_t *count) {
+	uint64_t data;
+	if (!find(tt, TT_PERFT_KEY(key, depth), &data) || TT_BOUND(data) != TT_BOUND_NONE || TT_DEPTH(data) != depth) return false;
+	*count = TT_COUNT(data);
+	return true;
+}
+
+void tt_store_count(struct tt *tt, uint64_t key, uint8_t depth, uint64_t count) {
+	if (count > TT_COUNT_MAX) return;
+	store(tt, TT_PERFT_KEY(key, depth), depth | (uint64_t) generation(tt) << 8 | count << 16);
+}
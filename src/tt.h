@@ -0,0 +1,58 @@
+#ifndef TT_H
+#define TT_H
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// transposition table shared by every thread without locks
+// each entry is stored as the key xored with the data, so an entry torn by two threads writing at once fails the key check and is ignored
+// one bucket of entries fills a cache line, so a probe reads a single line
+#define TT_BUCKET_ENTRIES (4)
+#define TT_DEFAULT_SIZE (16) // megabytes
+#define TT_MAX_SIZE (1 << 20)
+
+struct tt_entry {
+	_Atomic uint64_t check; // key ^ data
+	_Atomic uint64_t data;
+};
+
+struct tt_bucket {
+	_Alignas(64) struct tt_entry entries[TT_BUCKET_ENTRIES];
+};
+
+struct tt {
+	struct tt_bucket *buckets;
+	size_t mask; // number of buckets - 1, the count is a power of two
+	size_t size; // bytes allocated
+	_Atomic uint8_t generation; // increased for every search, older entries are replaced first, only the low 6 bits are stored
+};
+
+enum tt_bound {
+	TT_BOUND_NONE,  // not a search entry, such as a perft count
+	TT_BOUND_UPPER, // the score is at most this, every move failed low
+	TT_BOUND_LOWER, // the score is at least this, a move failed high
+	TT_BOUND_EXACT,
+};
+
+struct tt_hit {
+	uint16_t move; // packed move, 0 if none
+	int16_t score;
+	uint8_t depth;
+	enum tt_bound bound;
+};
+
+bool tt_create(struct tt *tt, size_t megabytes); // returns false if memory ran out, on Linux large tables are backed by huge pages when available
+void tt_destroy(struct tt *tt);
+void tt_clear(struct tt *tt);
+void tt_new_search(struct tt *tt);
+bool tt_probe(struct tt *tt, uint64_t key, struct tt_hit *hit);
+void tt_store(struct tt *tt, uint64_t key, uint8_t depth, enum tt_bound bound, int score, uint16_t move); // a move of 0 keeps the stored one
+// perft node counts, kept apart from the search entries of the same position
+bool tt_probe_count(struct tt *tt, uint64_t key, uint8_t depth, uint64_t *count);
+void tt_store_count(struct tt *tt, uint64_t key, uint8_t depth, uint64_t count);
+
+static inline void tt_prefetch(struct tt *tt, uint64_t key) {
+	__builtin_prefetch(&tt->buckets[key & tt->mask]);
+}
+#endif
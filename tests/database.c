@@ -0,0 +1,144 @@
+#include "test.h"
+#include <stddef.h>
+
+#include "chess.h"
+#include "database.h"
+#include "fen.h"
+
+static uint16_t san_move(struct game *game, const char *san) {
+	uint16_t move = 0;
+	find_san_move(game, san, strlen(san), &move);
+	return move;
+}
+
+// writes a copy of the database file with part of it changed, returns false if the copy could not be made
+static bool write_changed(const uint8_t *data, size_t size, size_t offset, const void *value, size_t length, char *path) {
+	uint8_t *copy = malloc(size);
+	if (!copy) return false;
+	memcpy(copy, data, size);
+	memcpy(copy + offset, value, length);
+	bool ok = test_write_file(path, copy, size);
+	free(copy);
+	return ok;
+}
+
+static void test_corrupt(const struct database *database) {
+	const struct database_header *header = database->header;
+	struct {
+		size_t offset;
+		uint64_t value;
+	} changes[] = {
+		{offsetof(struct database_header, magic), 0},
+		{offsetof(struct database_header, version), DATABASE_VERSION + 1},
+		{offsetof(struct database_header, game_count), header->game_count + 1},
+		{offsetof(struct database_header, entry_count), header->entry_count + 1},
+		{offsetof(struct database_header, offsets_offset), header->records_offset},
+		{offsetof(struct database_header, records_offset), header->entries_offset + 8},
+		{offsetof(struct database_header, entries_offset), database->size},
+	};
+	for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); ++i) {
+		char path[] = "/tmp/chess-test-XXXXXX";
+		size_t length = changes[i].offset == offsetof(struct database_header, version) ? 4 : 8;
+		if (!CHECK(write_changed(database->data, database->size, changes[i].offset, &changes[i].value, length, path))) continue;
+		struct database copy;
+		if (!CHECK(!database_open(&copy, path))) {
+			fprintf(stderr, "  accepted change %zu\n", i);
+			database_close(&copy);
+		}
+		unlink(path);
+	}
+
+	// a truncated file
+	char path[] = "/tmp/chess-test-XXXXXX";
+	if (CHECK(test_write_file(path, database->data, database->size - 1))) {
+		struct database copy;
+		if (!CHECK(!database_open(&copy, path))) database_close(&copy);
+		unlink(path);
+	}
+}
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	struct database_builder *builder = database_builder_create();
+	if (!CHECK(game && builder)) return TEST_EXIT();
+
+	static const char *const games[][4] = {
+		{"e4", "e5", "Nf3"},
+		{"e4", "c5"},
+		{"d4", "d5"},
+		{"e4", "e5", "Nc3", "Nf6"},
+	};
+	static const size_t lengths[] = {3, 2, 2, 4};
+	static const enum pgn_result results[] = {PGN_RESULT_WHITE_WIN, PGN_RESULT_BLACK_WIN, PGN_RESULT_DRAW, PGN_RESULT_WHITE_WIN};
+	for (size_t i = 0; i < 3; ++i) {
+		CHECK(test_play(game, NULL, games[i], lengths[i]));
+		CHECK(database_add_game(builder, game, results[i]));
+	}
+	// the last game is added from its record
+	uint8_t record[RECORD_MAX_SIZE(4)];
+	CHECK(test_play(game, NULL, games[3], lengths[3]));
+	size_t size = record_write(game, results[3], record, sizeof(record));
+	CHECK(database_add_record(builder, record, size));
+	uint64_t last_key = game->key;
+	CHECK(!database_add_record(builder, record, size - 1));
+	CHECK(database_builder_games(builder) == 4);
+
+	char path[] = "/tmp/chess-test-XXXXXX";
+	CHECK(test_write_file(path, "", 0));
+	CHECK(database_write(builder, path));
+	database_builder_destroy(builder);
+
+	struct database database;
+	if (!CHECK(database_open(&database, path))) {
+		unlink(path);
+		destroy_board(game);
+		return TEST_EXIT();
+	}
+	CHECK(database.header->game_count == 4);
+	CHECK(database.header->entry_count == 4 + 3 + 3 + 5); // every position of every game
+
+	// the start position was reached in every game
+	board_init(game);
+	const struct database_entry *first;
+	CHECK(database_find(&database, game->key, &first) == 4);
+	struct database_continuation continuations[8];
+	size_t count = database_continuations(&database, game->key, continuations, 8);
+	if (CHECK(count == 2)) {
+		CHECK(continuations[0].move == san_move(game, "e4"));
+		CHECK(continuations[0].games == 3);
+		CHECK(continuations[0].results[PGN_RESULT_WHITE_WIN] == 2);
+		CHECK(continuations[0].results[PGN_RESULT_BLACK_WIN] == 1);
+		CHECK(continuations[1].move == san_move(game, "d4"));
+		CHECK(continuations[1].games == 1);
+		CHECK(continuations[1].results[PGN_RESULT_DRAW] == 1);
+	}
+	// the same statistics from the entries already found
+	struct database_continuation summary[8];
+	if (CHECK(database_summarize(first, 4, summary, 8) == count))
+		for (size_t i = 0; i < count; ++i) CHECK(summary[i].move == continuations[i].move && summary[i].games == continuations[i].games);
+	CHECK(database_continuations(&database, game->key, continuations, 1) == 1);
+
+	// the final position of a game has no move played in it
+	CHECK(database_find(&database, last_key, &first) == 1);
+	CHECK(first->move == 0 && first->ply == 4);
+	CHECK(DATABASE_ENTRY_GAME(first) == 3);
+	CHECK(DATABASE_ENTRY_RESULT(first) == PGN_RESULT_WHITE_WIN);
+	CHECK(database_continuations(&database, last_key, continuations, 8) == 0);
+	CHECK(database_find(&database, last_key ^ 1, &first) == 0);
+
+	// each game's record replays to its final position
+	struct record_header header;
+	CHECK(database_game(&database, 3, &header));
+	CHECK(record_replay(game, &header, false));
+	CHECK(game->key == last_key);
+	CHECK(database_game(&database, 0, &header));
+	CHECK(header.plies == 3 && header.result == PGN_RESULT_WHITE_WIN);
+	CHECK(!database_game(&database, 4, &header));
+
+	test_corrupt(&database);
+	database_close(&database);
+	unlink(path);
+
+	destroy_board(game);
+	return TEST_EXIT();
+}
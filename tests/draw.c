@@ -0,0 +1,80 @@
+#include "test.h"
+
+#include "chess.h"
+
+// knights out and back, which repeats the start position every four plies
+static const char *const shuffles[] = {
+	"Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8", "Nf3", "Nf6", "Ng1", "Ng8",
+};
+
+static void test_repetition(struct game *game) {
+	// the start position is seen once more after every shuffle
+	for (size_t times = 0; times <= 3; ++times) {
+		if (!CHECK(test_play(game, NULL, shuffles, times * 4))) return;
+		CHECK(count_repetitions(game) == times);
+		CHECK(game->win == STATE_NONE);
+		CHECK(get_draw_claim(game) == (times >= 2 ? STATE_THREEFOLD_REPETITION : STATE_NONE));
+	}
+
+	// a claim ends the game, after which there is nothing left to claim
+	CHECK(test_play(game, NULL, shuffles, 8));
+	CHECK(claim_draw(game));
+	CHECK(game->win == STATE_THREEFOLD_REPETITION);
+	CHECK(get_draw_claim(game) == STATE_NONE);
+	CHECK(!claim_draw(game));
+
+	// the fifth occurrence ends the game without a claim
+	CHECK(test_play(game, NULL, shuffles, 16));
+	CHECK(game->win == STATE_FIVEFOLD_REPETITION);
+
+	// positions before a pawn move are never repeated, so their history is dropped
+	static const char *const moves[] = {"Nf3", "Nf6", "Ng1", "Ng8", "e4", "Nf6", "Nf3"};
+	CHECK(test_play(game, NULL, moves, 4));
+	CHECK(game->undo_count == 4);
+	CHECK(test_play(game, NULL, moves, 5));
+	CHECK(game->undo_count == 0);
+	CHECK(test_play(game, NULL, moves, 7));
+	CHECK(game->undo_count == 2);
+	CHECK(count_repetitions(game) == 0);
+
+	// and so are positions before a capture
+	static const char *const capture[] = {"e4", "d5", "Nc3", "Nf6", "exd5"};
+	CHECK(test_play(game, NULL, capture, 4));
+	CHECK(game->undo_count == 2);
+	CHECK(test_play(game, NULL, capture, 5));
+	CHECK(game->undo_count == 0);
+	CHECK(game->half_move == 0);
+}
+
+static void test_move_rules(struct game *game) {
+	static const char *const rook[] = {"Ra2"}, *const pawn[] = {"e3"}, *const mate[] = {"Ra8#"};
+
+	// the fifty move rule can be claimed from the hundredth ply
+	CHECK(test_play(game, "4k3/8/8/8/8/8/4P3/R3K3 w - - 98 80", NULL, 0));
+	CHECK(get_draw_claim(game) == STATE_NONE);
+	CHECK(test_play(game, "4k3/8/8/8/8/8/4P3/R3K3 w - - 99 80", rook, 1));
+	CHECK(game->half_move == 100);
+	CHECK(game->win == STATE_NONE);
+	CHECK(get_draw_claim(game) == STATE_FIFTY_MOVE_RULE);
+	CHECK(test_play(game, "4k3/8/8/8/8/8/4P3/R3K3 w - - 99 80", pawn, 1));
+	CHECK(get_draw_claim(game) == STATE_NONE);
+
+	// and the game ends by itself at the hundred and fiftieth
+	CHECK(test_play(game, "4k3/8/8/8/8/8/4P3/R3K3 w - - 148 80", rook, 1));
+	CHECK(game->win == STATE_NONE);
+	CHECK(test_play(game, "4k3/8/8/8/8/8/4P3/R3K3 w - - 149 80", rook, 1));
+	CHECK(game->win == STATE_SEVENTY_FIVE_MOVE_RULE);
+
+	// unless that move is checkmate
+	CHECK(test_play(game, "6k1/5ppp/8/8/8/8/8/R5K1 w - - 149 80", mate, 1));
+	CHECK(game->win == STATE_CHECKMATE_WHITE_WIN);
+}
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+	test_repetition(game);
+	test_move_rules(game);
+	destroy_board(game);
+	return TEST_EXIT();
+}
@@ -0,0 +1,64 @@
+#include "test.h"
+
+#include "epd.h"
+
+static const char passing[] =
+	"# perft counts, best moves and move counters\n"
+	"\n"
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - D1 20; D2 400; D3 8902; id \"start\";\n"
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - D1 48; D2 2039;\r\n"
+	"6k1/5ppp/8/8/8/8/8/R5K1 w - - bm Ra8#; id \"mate\";\n"
+	"6k1/5ppp/8/8/8/8/5PPP/R5K1 w - - am Kf1 Kh1; hmvc 12; fmvn 30;\n"
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1; D1 20;\n"
+	"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 ;D1 7 ;D2 38\n";
+
+static const char failing[] =
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - D1 21;\n"
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - D1 20;\n"
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - hmvc x;\n"
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - bm Qh5;\n"
+	"4k3/8/8/3P4/8/8/8/4K3 w - e6 D1 6;\n";
+
+// runs the suite and writes the summary it printed to output
+static bool run(const char *suite, char *output, size_t size) {
+	char path[] = "/tmp/chess-test-XXXXXX";
+	output[0] = '\0';
+	if (!CHECK(test_write_file(path, suite, strlen(suite)))) return false;
+	FILE *fp = tmpfile();
+	bool result = false;
+	if (CHECK(fp)) {
+		result = run_epd(path, 2, (struct search_limits){.depth = 4}, NULL, fp);
+		rewind(fp);
+		size_t length = fread(output, 1, size - 1, fp);
+		output[length] = '\0';
+		fclose(fp);
+	}
+	unlink(path);
+	return result;
+}
+
+int main(void) {
+	char output[4096];
+
+	CHECK(run(passing, output, sizeof(output)));
+	CHECK(strstr(output, "Records: 6\n"));
+	CHECK(strstr(output, "Passed: 6\n"));
+
+	// every record is still checked after one fails, and each problem is reported with its line
+	CHECK(!run(failing, output, sizeof(output)));
+	CHECK(strstr(output, "Records: 5\n"));
+	CHECK(strstr(output, "Passed: 1\n"));
+	CHECK(strstr(output, "Failed: 1\n"));
+	CHECK(strstr(output, "Invalid: 3\n"));
+	CHECK(strstr(output, ":3: invalid count for hmvc"));
+	CHECK(strstr(output, ":4: illegal move Qh5"));
+	CHECK(strstr(output, ":5: invalid position"));
+
+	// a file that does not exist fails
+	FILE *fp = tmpfile();
+	if (CHECK(fp)) {
+		CHECK(!run_epd("/nonexistent/suite.epd", 1, (struct search_limits){.depth = 1}, NULL, fp));
+		fclose(fp);
+	}
+	return TEST_EXIT();
+}
@@ -0,0 +1,85 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+#include "perft.h"
+
+static const char *const valid[] = {
+	FEN_START_POSITION,
+	"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+	"rnbqkbnr/ppp1pppp/8/8/3pP3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 3",
+	"rnbqkbnr/pppp1ppp/8/3Pp3/8/8/PPP1PPPP/RNBQKBNR w Kq e6 0 3",
+	"8/8/8/8/8/8/8/k1K5 b - - 99 120",
+};
+
+static const char *const invalid[] = {
+	"",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP w KQkq - 0 1",          // seven ranks
+	"rnbqkbnr/pppppppp/9/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1", // nine squares
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBN w KQkq - 0 1",  // seven squares
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQXBNR w KQkq - 0 1", // unknown piece
+	"rnbq1bnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQ - 0 1",   // no black king
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBKKBNR w KQkq - 0 1", // two white kings
+	"Pnbqkbnr/pppppppp/8/8/8/8/1PPPPPPP/RNBQKBNR w KQkq - 0 1", // pawn on the last rank
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR x KQkq - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQxq - 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e9 0 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq e3 0 1", // en passant square on the wrong rank
+	"4k3/8/8/3PN3/8/8/8/4K3 w - e6 0 1",                         // nothing moved two squares to e5
+	"4k3/8/8/3P4/8/8/8/4K3 w - e6 0 1",
+	"4k3/8/8/3Pp3/8/8/8/4K3 b - e6 0 1",                         // the player who moved the pawn is to move
+	"4k3/4p3/8/3Pp3/8/8/8/4K3 w - e6 0 1",                       // the square the pawn came from is taken
+	"4k3/8/8/8/8/8/8/4R1K1 w - - 0 1",                           // black is in check with white to move
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - x 1",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0",
+	"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1 x",
+};
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+	char fen[FEN_MAX_LENGTH];
+
+	// valid positions are written back exactly as they were read
+	for (size_t i = 0; i < sizeof(valid) / sizeof(valid[0]); ++i) {
+		if (!CHECK(game_from_fen(game, valid[i], NULL))) continue;
+		CHECK(game_to_fen(game, fen) == strlen(valid[i]));
+		CHECK(strcmp(fen, valid[i]) == 0);
+		CHECK(game->key == compute_key(game));
+	}
+
+	// the move counters are optional, and spaces between fields are allowed
+	CHECK(game_from_fen(game, "  4k3/8/8/8/8/8/8/4K3   b  -  - ", NULL));
+	game_to_fen(game, fen);
+	CHECK(strcmp(fen, "4k3/8/8/8/8/8/8/4K3 b - - 0 1") == 0);
+
+	// an invalid string leaves the game as it was and says where the problem is
+	CHECK(game_from_fen(game, valid[1], NULL));
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+		struct fen_error error = {0};
+		if (!CHECK(!game_from_fen(game, invalid[i], &error))) {
+			fprintf(stderr, "  accepted %s\n", invalid[i]);
+			continue;
+		}
+		CHECK(error.message != NULL);
+		CHECK(error.offset <= strlen(invalid[i]));
+	}
+	game_to_fen(game, fen);
+	CHECK(strcmp(fen, valid[1]) == 0);
+
+	// en passant is only generated where a pawn has just moved two squares
+	CHECK(game_from_fen(game, "4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1", NULL));
+	CHECK(perft(game, 1) == 7);
+	CHECK(game_from_fen(game, "4k3/8/8/3Pp3/8/8/8/4K3 w - - 0 1", NULL));
+	CHECK(perft(game, 1) == 6);
+
+	// EPD has the four position fields, followed by the operations
+	const char *operations = game_from_epd(game, "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 bm e5; id \"x\";", NULL);
+	if (CHECK(operations)) CHECK(strcmp(operations, "bm e5; id \"x\";") == 0);
+	game_to_fen(game, fen);
+	CHECK(strcmp(fen, "rnbqkbnr/pppppppp/8/8/4P3/8/PPPP1PPP/RNBQKBNR b KQkq e3 0 1") == 0);
+	CHECK(!game_from_epd(game, "4k3/8/8/3P4/8/8/8/4K3 w - e6 bm d6;", NULL));
+
+	destroy_board(game);
+	return TEST_EXIT();
+}
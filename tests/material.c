@@ -0,0 +1,68 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+
+static const struct {
+	const char *fen;
+	bool insufficient;
+} positions[] = {
+	{"7k/8/8/8/8/8/8/7K w - - 0 1", true},             // kings only
+	{"7k/8/8/8/8/8/8/6NK w - - 0 1", true},            // a knight
+	{"5b1k/8/8/8/8/8/8/7K w - - 0 1", true},           // a bishop
+	{"6nk/8/8/8/8/8/8/6NK w - - 0 1", false},          // a knight each
+	{"2b4k/8/8/8/8/8/8/6NK w - - 0 1", false},         // a knight and a bishop
+	{"2b4k/8/8/8/8/8/8/2B4K w - - 0 1", false},        // bishops on opposite colors
+	{"5b1k/8/8/8/8/8/8/2B4K w - - 0 1", true},         // bishops on the same color
+	{"7k/8/8/8/8/8/8/2B1B2K w - - 0 1", true},         // two bishops on the same color
+	{"7k/8/8/8/8/8/8/2B2B1K w - - 0 1", false},        // two bishops on opposite colors
+	{"3b1b1k/8/8/8/8/8/8/7K b - - 0 1", true},         // black's bishops on the same color
+	{"5b1k/8/8/8/8/8/8/2B1B2K w - - 0 1", true},       // three bishops on the same color
+	{"2b2b1k/8/8/8/8/8/8/2B1B2K w - - 0 1", false},    // three bishops on one color and one on the other
+	{"7k/8/8/8/8/8/8/2N1N2K w - - 0 1", false},        // two knights
+	{"5nnk/8/8/8/8/8/8/7K w - - 0 1", false},          // black's two knights
+	{"7k/8/8/8/8/8/8/2B1N2K w - - 0 1", false},        // a bishop and a knight
+	{"7k/8/8/8/8/8/8/1NN1N2K w - - 0 1", false},       // three knights
+	{"7k/8/8/8/8/8/P7/7K w - - 0 1", false},           // a pawn
+	{"7k/8/8/8/8/8/8/R6K w - - 0 1", false},           // a rook
+	{"7k/8/8/8/8/8/8/1Q5K w - - 0 1", false},          // a queen
+	{"7k/p7/8/8/8/8/8/2B1B2K w - - 0 1", false},       // bishops against a pawn
+};
+
+static const struct {
+	const char *fen;
+	enum win_state win; // after white runs out of time
+} timeouts[] = {
+	{"7k/8/8/8/8/8/8/R6K w - - 0 1", STATE_TIMEOUT_INSUFFICIENT_MATERIAL},   // black has only a king
+	{"6nk/8/8/8/8/8/8/R6K w - - 0 1", STATE_TIMEOUT_INSUFFICIENT_MATERIAL},  // black has one knight
+	{"5b1k/8/8/8/8/8/8/R6K w - - 0 1", STATE_TIMEOUT_INSUFFICIENT_MATERIAL}, // black has one bishop
+	{"5nnk/8/8/8/8/8/8/R6K w - - 0 1", STATE_TIMEOUT_BLACK_WIN},             // black has two knights
+	{"7k/p7/8/8/8/8/8/R6K w - - 0 1", STATE_TIMEOUT_BLACK_WIN},              // black has a pawn
+	{"7k/8/8/8/8/8/8/6NK w - - 0 1", STATE_INSUFFICIENT_MATERIAL},           // the game was already over
+};
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+
+	for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i) {
+		if (!CHECK(game_from_fen(game, positions[i].fen, NULL))) continue;
+		if (!CHECK(insufficient_material(game) == positions[i].insufficient)) fprintf(stderr, "  %s\n", positions[i].fen);
+	}
+
+	for (size_t i = 0; i < sizeof(timeouts) / sizeof(timeouts[0]); ++i) {
+		if (!CHECK(game_from_fen(game, timeouts[i].fen, NULL))) continue;
+		// a game already over keeps its result
+		if (insufficient_material(game)) game->win = STATE_INSUFFICIENT_MATERIAL;
+		set_timeout(game, COLOR_WHITE);
+		if (!CHECK(game->win == timeouts[i].win)) fprintf(stderr, "  %s\n", timeouts[i].fen);
+	}
+
+	// the game ends when a capture leaves neither player able to checkmate
+	static const char *const capture[] = {"Nxf1"};
+	CHECK(test_play(game, "7k/8/8/8/8/4n3/8/5R1K b - - 0 1", capture, 1));
+	CHECK(game->win == STATE_INSUFFICIENT_MATERIAL);
+
+	destroy_board(game);
+	return TEST_EXIT();
+}
@@ -0,0 +1,57 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+#include "perft.h"
+#include "tt.h"
+
+// published counts for the CPW positions used by the bench, at depths that run quickly
+static const struct {
+	const char *fen;
+	uint8_t depth;
+	uint64_t nodes;
+} positions[] = {
+        {FEN_START_POSITION,                                                         4, 197281 },
+        {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",     3, 97862  },
+        {"8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1",                               5, 674624 },
+        {"r3k2r/Pppp1ppp/1b3nbN/nP6/BBP1P3/q4N2/Pp1P2PP/R2Q1RK1 w kq - 0 1",         4, 422333 },
+        {"rnbq1k1r/pp1Pbppp/2p5/8/2B5/8/PPP1NnPP/RNBQK2R w KQ - 1 8",                3, 62379  },
+        {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10", 3, 89890  },
+        // en passant that would expose the king or gives check, and promotions
+        {"3k4/3p4/8/K1P4r/8/8/8/8 b - - 0 1",                                       6, 1134888},
+        {"8/5bk1/8/2Pp4/8/1K6/8/8 w - d6 0 1",                                      6, 824064 },
+        {"8/8/1k6/2b5/2pP4/8/5K2/8 b - d3 0 1",                                     6, 1440467},
+        {"n1n5/PPPk4/8/8/8/8/4Kppp/5N1N b - - 0 1",                                 3, 9483   },
+};
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+	static struct tt tt;
+	CHECK(tt_create(&tt, 1));
+
+	for (size_t i = 0; i < sizeof(positions) / sizeof(positions[0]); ++i) {
+		if (!CHECK(game_from_fen(game, positions[i].fen, NULL))) continue;
+		uint64_t key = game->key;
+		CHECK(perft(game, positions[i].depth) == positions[i].nodes);
+		// make_move and unmake_move leave the position as it was
+		char fen[FEN_MAX_LENGTH];
+		game_to_fen(game, fen);
+		CHECK(strcmp(fen, positions[i].fen) == 0);
+		CHECK(game->key == key && key == compute_key(game));
+		// the table gives the same counts, also when they are already stored
+		CHECK(perft_tt(game, positions[i].depth, &tt) == positions[i].nodes);
+		CHECK(perft_tt(game, positions[i].depth, &tt) == positions[i].nodes);
+	}
+
+	// the bench checks its own counts, split over threads
+	FILE *out = tmpfile();
+	if (CHECK(out)) {
+		CHECK(run_bench((struct perft_options){.threads = 2, .split_depth = 2}, out));
+		fclose(out);
+	}
+
+	tt_destroy(&tt);
+	destroy_board(game);
+	return TEST_EXIT();
+}
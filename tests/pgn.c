@@ -0,0 +1,197 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+#include "pgn.h"
+
+static const char games[] =
+	"[Event \"A \\\"quoted\\\" \\\\ event\"]\n"
+	"[White \"Someone\"]\n"
+	"\n"
+	"1.e4 {the king's pawn} e5 (1...c5 {sicilian (b)} 2.Nf3) 2.Nf3 $1 Nc6 ; to the end of the line\n"
+	"3.Bb5 a6 1-0\n"
+	"\n"
+	"% an escaped line\n"
+	"1.e4 e5 2.Ke3 Nc6 1-0\n"
+	"\n"
+	"[SetUp \"1\"]\n"
+	"[FEN \"r3k3/8/8/8/8/8/8/4K2R b Kq - 0 12\"]\n"
+	"\n"
+	"12...O-O-O 13.0-0 Rd2 *\n"
+	"\n"
+	"[FEN \"not a position\"]\n"
+	"1.e4 1/2-1/2\n"
+	"1.d4 d5 2.c4 1/2-1/2\n";
+
+struct collected {
+	size_t tags, comments, variations;
+	char event[PGN_TAG_VALUE_MAX], comment[PGN_TEXT_MAX], variation[PGN_TEXT_MAX];
+};
+
+static void on_tag(void *data, const char *name, const char *value) {
+	struct collected *collected = data;
+	++collected->tags;
+	if (strcmp(name, "Event") == 0) snprintf(collected->event, sizeof(collected->event), "%s", value);
+}
+
+static void on_comment(void *data, const char *text) {
+	struct collected *collected = data;
+	if (collected->comments++ == 0) snprintf(collected->comment, sizeof(collected->comment), "%s", text);
+}
+
+static void on_variation(void *data, const char *text) {
+	struct collected *collected = data;
+	++collected->variations;
+	snprintf(collected->variation, sizeof(collected->variation), "%s", text);
+}
+
+// the move a SAN string resolves to in the position, as UCI, or the reason it did not
+static const char *san_to_uci(struct game *game, const char *fen, const char *san) {
+	static char uci[16];
+	uint16_t move;
+	if (!game_from_fen(game, fen, NULL)) return "invalid position";
+	enum find_move_reason reason = find_san_move(game, san, strlen(san), &move);
+	if (reason == REASON_AMBIGUOUS) return "ambiguous";
+	if (reason != REASON_SUCCESS) return "not found";
+	move_to_uci(move, uci);
+	return uci;
+}
+
+static void test_reader(struct game *game) {
+	struct pgn_reader reader;
+	struct pgn_game info;
+	struct collected collected = {0};
+	struct pgn_callbacks callbacks = {.data = &collected, .tag = on_tag, .comment = on_comment, .variation = on_variation};
+	pgn_reader_init_memory(&reader, games, strlen(games));
+
+	// comments, variations, annotation glyphs and escaped tag values
+	CHECK(pgn_read_game(&reader, game, &callbacks, &info) == PGN_GAME);
+	CHECK(info.line == 1);
+	CHECK(info.plies == 6);
+	CHECK(info.result == PGN_RESULT_WHITE_WIN);
+	CHECK(collected.tags == 2);
+	CHECK(strcmp(collected.event, "A \"quoted\" \\ event") == 0);
+	CHECK(collected.comments == 2);
+	CHECK(strcmp(collected.comment, "the king's pawn") == 0);
+	CHECK(collected.variations == 1);
+	CHECK(strcmp(collected.variation, "1...c5 {sicilian (b)} 2.Nf3") == 0);
+	CHECK(strcmp(get_move_text(game), "1.e4 e5  2.Nf3 Nc6  3.Bb5 a6") == 0);
+
+	// an illegal move is reported with its line, and the game is still read to its end
+	CHECK(pgn_read_game(&reader, game, NULL, &info) == PGN_INVALID);
+	CHECK(info.line == 8);
+	CHECK(info.plies == 2);
+	CHECK(info.error && strcmp(info.error, "illegal move") == 0);
+	CHECK(info.error_line == 8);
+	CHECK(strcmp(info.error_token, "Ke3") == 0);
+
+	// a game from a FEN tag, starting with black's move, with castling written both ways
+	CHECK(pgn_read_game(&reader, game, NULL, &info) == PGN_GAME);
+	CHECK(info.plies == 3);
+	CHECK(info.result == PGN_RESULT_UNKNOWN);
+	char fen[FEN_MAX_LENGTH];
+	game_to_fen(game, fen);
+	CHECK(strcmp(fen, "2k5/8/8/8/8/8/3r4/5RK1 w - - 3 14") == 0);
+
+	CHECK(pgn_read_game(&reader, game, NULL, &info) == PGN_INVALID);
+	CHECK(info.error && strcmp(info.error, "invalid FEN tag") == 0);
+
+	// a game without tags
+	CHECK(pgn_read_game(&reader, game, NULL, &info) == PGN_GAME);
+	CHECK(info.plies == 3);
+	CHECK(info.result == PGN_RESULT_DRAW);
+	CHECK(pgn_read_game(&reader, game, NULL, &info) == PGN_END);
+}
+
+static void test_round_trip(struct game *game) {
+	// a written game reads back to the same moves and tags
+	static const char *const moves[] = {"d4", "Nf6", "c4", "e6", "Nc3", "Bb4", "Qc2", "O-O", "a3", "Bxc3+", "Qxc3", "b6"};
+	if (!CHECK(test_play(game, NULL, moves, sizeof(moves) / sizeof(moves[0])))) return;
+	struct pgn_tag tags[] = {{"White", "A \"B\" C"}, {"Opening", "Nimzo-Indian"}, {"Result", "1-0"}};
+	char *text = pgn_game_to_string(game, tags, sizeof(tags) / sizeof(tags[0]));
+	if (!CHECK(text)) return;
+	CHECK(strstr(text, "[White \"A \\\"B\\\" C\"]\n"));
+	CHECK(strstr(text, "[Date \"????.??.??\"]\n"));
+	CHECK(strstr(text, "[Result \"*\"]\n"));
+	CHECK(strstr(text, "[Opening \"Nimzo-Indian\"]\n"));
+	CHECK(!strstr(text, "[FEN"));
+
+	struct game *copy = create_board(malloc, free);
+	if (CHECK(copy)) {
+		struct pgn_reader reader;
+		struct pgn_game info;
+		struct collected collected = {0};
+		struct pgn_callbacks callbacks = {.data = &collected, .tag = on_tag};
+		pgn_reader_init_memory(&reader, text, strlen(text));
+		CHECK(pgn_read_game(&reader, copy, &callbacks, &info) == PGN_GAME);
+		CHECK(info.plies == sizeof(moves) / sizeof(moves[0]));
+		CHECK(collected.tags == 8);
+		CHECK(strcmp(get_move_text(copy), get_move_text(game)) == 0);
+		CHECK(copy->key == game->key);
+		CHECK(pgn_read_game(&reader, copy, NULL, &info) == PGN_END);
+		destroy_board(copy);
+	}
+	free(text);
+
+	// a game from a position keeps its FEN and move numbers
+	CHECK(game_from_fen(game, "4k3/8/8/8/8/8/4P3/4K3 b - - 0 40", NULL));
+	uint16_t move;
+	CHECK(find_san_move(game, "Kd7", 3, &move) == REASON_SUCCESS && perform_packed_move(game, move));
+	text = pgn_game_to_string(game, NULL, 0);
+	if (!CHECK(text)) return;
+	CHECK(strstr(text, "[SetUp \"1\"]\n[FEN \"4k3/8/8/8/8/8/4P3/4K3 b - - 0 40\"]\n"));
+	CHECK(strstr(text, "\n40... Kd7 *\n"));
+	free(text);
+}
+
+static void test_san(struct game *game) {
+	const char *knights = "4k3/8/8/8/8/8/8/1N3N1K w - - 0 1";
+	CHECK(strcmp(san_to_uci(game, knights, "Nd2"), "ambiguous") == 0);
+	CHECK(strcmp(san_to_uci(game, knights, "Nbd2"), "b1d2") == 0);
+	CHECK(strcmp(san_to_uci(game, knights, "Nfd2"), "f1d2") == 0);
+	CHECK(strcmp(san_to_uci(game, knights, "N1d2"), "ambiguous") == 0);
+	CHECK(strcmp(san_to_uci(game, knights, "Nc3"), "b1c3") == 0);
+	CHECK(strcmp(san_to_uci(game, knights, "Ne4"), "not found") == 0);
+
+	const char *promotion = "1n5k/P7/8/8/8/8/8/K7 w - - 0 1";
+	CHECK(strcmp(san_to_uci(game, promotion, "a8=Q"), "a7a8q") == 0);
+	CHECK(strcmp(san_to_uci(game, promotion, "axb8=N"), "a7b8n") == 0);
+	CHECK(strcmp(san_to_uci(game, promotion, "a8"), "not found") == 0);
+	CHECK(strcmp(san_to_uci(game, promotion, "a8=K"), "not found") == 0);
+
+	const char *castling = "r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1";
+	CHECK(strcmp(san_to_uci(game, castling, "O-O"), "e1g1") == 0);
+	CHECK(strcmp(san_to_uci(game, castling, "O-O-O"), "e1c1") == 0);
+	CHECK(strcmp(san_to_uci(game, castling, "0-0"), "e1g1") == 0);
+	CHECK(strcmp(san_to_uci(game, "r3k2r/8/8/8/8/8/8/R3K2R w Qkq - 0 1", "O-O"), "not found") == 0);
+
+	// check and checkmate are written by move_to_san, and accepted by find_san_move
+	char san[16];
+	const char *mate = "6k1/5ppp/8/8/8/8/8/R5K1 w - - 0 1";
+	CHECK(strcmp(san_to_uci(game, mate, "Ra8#"), "a1a8") == 0);
+	CHECK(strcmp(san_to_uci(game, mate, "Ra8"), "a1a8") == 0);
+	uint16_t move;
+	if (CHECK(find_san_move(game, "Ra8", 3, &move) == REASON_SUCCESS)) {
+		move_to_san(game, move, san);
+		CHECK(strcmp(san, "Ra8#") == 0);
+	}
+	if (CHECK(find_san_move(game, "Ra7", 3, &move) == REASON_SUCCESS)) {
+		move_to_san(game, move, san);
+		CHECK(strcmp(san, "Ra7") == 0);
+	}
+	CHECK(game_from_fen(game, "4k3/8/8/8/8/8/8/R3K3 w - - 0 1", NULL));
+	if (CHECK(find_san_move(game, "Ra8+", 4, &move) == REASON_SUCCESS)) {
+		move_to_san(game, move, san);
+		CHECK(strcmp(san, "Ra8+") == 0);
+	}
+}
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+	test_reader(game);
+	test_round_trip(game);
+	test_san(game);
+	destroy_board(game);
+	return TEST_EXIT();
+}
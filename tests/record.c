@@ -0,0 +1,117 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+#include "record.h"
+
+static const char pgn[] =
+	"[Event \"?\"]\n"
+	"\n"
+	"1.e4 e5 2.Nf3 Nc6 3.Bb5 a6 4.Ba4 Nf6 5.O-O Be7 1/2-1/2\n"
+	"\n"
+	"[FEN \"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1\"]\n"
+	"1.dxe6 Kf8 2.e7+ Ke8 3.Kd2 Kxe7 *\n";
+
+static void test_round_trip(struct game *game, struct game *copy, const char *fen, const char *const *moves, size_t count) {
+	if (!CHECK(test_play(game, fen, moves, count))) return;
+	uint8_t buffer[RECORD_MAX_SIZE(64)];
+	size_t size = record_write(game, PGN_RESULT_BLACK_WIN, buffer, sizeof(buffer));
+	if (!CHECK(size > 0)) return;
+	CHECK(size <= RECORD_MAX_SIZE(count));
+	// a record too big for the buffer is not written
+	CHECK(record_write(game, PGN_RESULT_BLACK_WIN, buffer, size - 1) == 0);
+
+	struct record_header header;
+	if (!CHECK(record_read(buffer, size, &header))) return;
+	CHECK(header.size == size);
+	CHECK(header.plies == count);
+	CHECK(header.result == PGN_RESULT_BLACK_WIN);
+	CHECK(strcmp(header.start_fen, fen ? fen : "") == 0);
+
+	// both ways of replaying reach the same position, and annotating gives the same move list
+	char expected[FEN_MAX_LENGTH], actual[FEN_MAX_LENGTH];
+	game_to_fen(game, expected);
+	CHECK(record_replay(copy, &header, false));
+	game_to_fen(copy, actual);
+	CHECK(strcmp(actual, expected) == 0);
+	CHECK(copy->key == game->key);
+	CHECK(record_replay(copy, &header, true));
+	game_to_fen(copy, actual);
+	CHECK(strcmp(actual, expected) == 0);
+	CHECK(strcmp(get_move_text(copy), get_move_text(game)) == 0);
+
+	// a truncated record is rejected by its header, a move that does not exist when it is replayed
+	for (size_t length = 0; length < size; ++length) CHECK(!record_read(buffer, length, &header));
+	if (count > 0) {
+		buffer[size - 1] = 0xFF;
+		CHECK(record_read(buffer, size, &header));
+		CHECK(!record_replay(copy, &header, false));
+	}
+}
+
+static void test_files(struct game *game) {
+	char input[] = "/tmp/chess-test-XXXXXX", output[] = "/tmp/chess-test-XXXXXX";
+	if (!CHECK(test_write_file(input, pgn, strlen(pgn)))) return;
+	if (!CHECK(test_write_file(output, "", 0))) {
+		unlink(input);
+		return;
+	}
+	FILE *fp = tmpfile();
+	if (CHECK(fp)) {
+		char *inputs[] = {input};
+		CHECK(run_record_convert(output, inputs, 1, fp));
+		fclose(fp);
+	}
+
+	// the stream has one record after another
+	FILE *in = fopen(output, "rb");
+	if (CHECK(in)) {
+		size_t length;
+		uint8_t *data = record_read_file(in, &length);
+		if (CHECK(data)) {
+			struct record_header header;
+			CHECK(record_read(data, length, &header));
+			CHECK(header.plies == 10 && header.result == PGN_RESULT_DRAW);
+			CHECK(record_replay(game, &header, false));
+			CHECK(header.size < length);
+			CHECK(record_read(data + header.size, length - header.size, &header));
+			CHECK(header.plies == 6 && header.result == PGN_RESULT_UNKNOWN);
+			CHECK(header.moves + 6 == data + length);
+			free(data);
+		}
+		fclose(in);
+	}
+
+	// and is printed back as PGN
+	fp = tmpfile();
+	if (CHECK(fp)) {
+		CHECK(run_record_print(output, fp));
+		char text[4096];
+		rewind(fp);
+		size_t length = fread(text, 1, sizeof(text) - 1, fp);
+		text[length] = '\0';
+		CHECK(strstr(text, "1. e4 e5 2. Nf3 Nc6 3. Bb5 a6 4. Ba4 Nf6 5. O-O Be7 1/2-1/2\n"));
+		CHECK(strstr(text, "[FEN \"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1\"]\n"));
+		// the replayed game ends with only the kings left, so it is a draw whatever its tag said
+		CHECK(strstr(text, "1. dxe6 Kf8 2. e7+ Ke8 3. Kd2 Kxe7 1/2-1/2\n"));
+		fclose(fp);
+	}
+	unlink(input);
+	unlink(output);
+}
+
+int main(void) {
+	struct game *game = create_board(malloc, free), *copy = create_board(malloc, free);
+	if (!CHECK(game && copy)) return TEST_EXIT();
+
+	static const char *const opening[] = {"e4", "c5", "Nf3", "d6", "d4", "cxd4", "Nxd4", "Nf6", "Nc3", "a6", "Be3", "e5", "Nb3", "Be6", "f3", "Be7", "Qd2", "O-O", "O-O-O"};
+	test_round_trip(game, copy, NULL, opening, sizeof(opening) / sizeof(opening[0]));
+	test_round_trip(game, copy, NULL, NULL, 0);
+	static const char *const promotion[] = {"a8=N", "Kg7", "Nb6", "Kf6", "Nd5+"};
+	test_round_trip(game, copy, "7k/P7/8/8/8/8/6K1/8 w - - 7 60", promotion, sizeof(promotion) / sizeof(promotion[0]));
+	test_files(game);
+
+	destroy_board(game);
+	destroy_board(copy);
+	return TEST_EXIT();
+}
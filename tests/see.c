@@ -0,0 +1,41 @@
+#include "test.h"
+
+#include "chess.h"
+#include "fen.h"
+#include "search.h"
+
+// material is counted as 100 for a pawn, 320 for a knight, 330 for a bishop, 500 for a rook and 900 for a queen
+static const struct {
+	const char *fen, *move;
+	int value;
+} exchanges[] = {
+	{"4k3/8/8/3p4/4P3/8/8/4K3 w - - 0 1", "exd5", 100},                         // an undefended pawn
+	{"4k3/8/8/3n4/8/8/8/3RK3 w - - 0 1", "Rxd5", 320},                          // an undefended knight
+	{"4k3/8/2p5/3p4/8/8/8/3QK3 w - - 0 1", "Qxd5", -800},                       // a queen for a defended pawn
+	{"1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1", "Rxe5", 100},           // the defender does not reach
+	{"1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1", "Nxe5", -220}, // batteries on both sides
+	{"3rk3/8/8/3p4/8/8/3R4/3RK3 w - - 0 1", "Rxd5", 100},                       // doubled rooks outlast the defender
+	{"4k3/3p4/8/8/8/8/3R4/3QK3 w - - 0 1", "Rxd7+", 100},                       // the king cannot recapture on a guarded square
+	{"4k3/8/8/3Pp3/8/8/8/4K3 w - e6 0 1", "dxe6", 100},                         // en passant
+	{"4k3/5p2/8/3Pp3/8/8/8/4K3 w - e6 0 1", "dxe6", 0},                         // en passant, recaptured
+	{"3k4/5p2/8/3Pp3/8/8/8/4RK2 w - e6 0 1", "dxe6", 100},                      // the captured pawn no longer blocks the rook
+	{"4k3/8/7p/8/8/5N2/8/4K3 w - - 0 1", "Ng5", -320},                          // a quiet move onto a guarded square
+	{"4k3/8/8/8/8/5N2/8/4K3 w - - 0 1", "Ng5", 0},                              // a quiet move onto a safe square
+	{"4k3/1P6/8/8/8/8/8/4K3 w - - 0 1", "b8=Q", 800},                           // a promotion
+	{"r3k3/1P6/8/8/8/8/8/4K3 w - - 0 1", "b8=Q", -100},                         // a promotion that is taken
+	{"r3k2r/8/8/8/8/8/8/R3K2R w KQkq - 0 1", "O-O", 0},                         // castling exchanges nothing
+};
+
+int main(void) {
+	struct game *game = create_board(malloc, free);
+	if (!CHECK(game)) return TEST_EXIT();
+	for (size_t i = 0; i < sizeof(exchanges) / sizeof(exchanges[0]); ++i) {
+		uint16_t move;
+		if (!CHECK(game_from_fen(game, exchanges[i].fen, NULL))) continue;
+		if (!CHECK(find_san_move(game, exchanges[i].move, strlen(exchanges[i].move), &move) == REASON_SUCCESS)) continue;
+		int value = see(game, move);
+		if (!CHECK(value == exchanges[i].value)) fprintf(stderr, "  %s %s: %d\n", exchanges[i].fen, exchanges[i].move, value);
+	}
+	destroy_board(game);
+	return TEST_EXIT();
+}
@@ -0,0 +1,48 @@
+#ifndef TEST_H
+#define TEST_H
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "chess.h"
+#include "fen.h"
+
+// each test is a program that checks everything it can and exits with 1 if any check failed
+#define CHECK(cond_) test_check((cond_), #cond_, __FILE__, __LINE__)
+#define TEST_EXIT() (test_failures ? 1 : 0)
+
+static unsigned test_failures = 0;
+
+static inline bool test_check(bool ok, const char *expression, const char *file, int line) {
+	if (!ok) {
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+		++test_failures;
+	}
+	return ok;
+}
+
+static inline bool test_write_file(char *path, const void *data, size_t length) {
+	// path is a mkstemp template such as "/tmp/chess-test-XXXXXX", filled in with the file's name
+	int fd = mkstemp(path);
+	if (fd < 0) return false;
+	bool ok = write(fd, data, length) == (ssize_t) length;
+	return close(fd) == 0 && ok;
+}
+
+static inline bool test_play(struct game *game, const char *fen, const char *const *moves, size_t count) {
+	// resets the game to the position, or the start position if fen is NULL, and plays the SAN moves
+	if (!fen)
+		board_init(game);
+	else if (!game_from_fen(game, fen, NULL))
+		return false;
+	clear_move_text(game);
+	for (size_t i = 0; i < count; ++i) {
+		uint16_t move;
+		if (find_san_move(game, moves[i], strlen(moves[i]), &move) != REASON_SUCCESS) return false;
+		if (!perform_packed_move(game, move)) return false;
+	}
+	return true;
+}
+#endif